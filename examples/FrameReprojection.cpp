@@ -0,0 +1,171 @@
+#include "FrameReprojection.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "rkcommon/tasking/parallel_for.h"
+
+using namespace rkcommon;
+using namespace rkcommon::math;
+
+// relative depth difference to a neighbour above which a pixel lies on an
+// edge, the warp would smear it so it is rendered instead
+#define REPROJECTION_EDGE_TOLERANCE 0.05f
+#define REPROJECTION_NO_PIXEL std::numeric_limits<uint64_t>::max()
+
+static uint32_t floatBits(float f)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+static float bitsFloat(uint32_t bits)
+{
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+FrameReprojection::View FrameReprojection::View::perspective(
+    const vec3f &position, const vec3f &direction, const vec3f &up,
+    float fovy, float aspect)
+{
+  View view;
+  view.position = position;
+  view.dir = normalize(direction);
+  const float imagePlaneHeight = 2.f * std::tan(deg2rad(0.5f * fovy));
+  const vec3f u = normalize(cross(view.dir, up));
+  view.du = u * imagePlaneHeight * aspect;
+  view.dv = cross(u, view.dir) * imagePlaneHeight;
+  return view;
+}
+
+vec3f FrameReprojection::View::rayDir(const vec2f &screen) const
+{
+  return normalize(dir + (screen.x - 0.5f) * du + (screen.y - 0.5f) * dv);
+}
+
+void FrameReprojection::resize(const vec2i &_size)
+{
+  if (size == _size)
+    return;
+  size = _size;
+  const size_t numPixels = size.long_product();
+  color.assign(numPixels, 0);
+  depth.assign(numPixels, std::numeric_limits<float>::infinity());
+  warpedColor.resize(numPixels);
+  warpedDepth.resize(numPixels);
+  nearest.reset(new std::atomic<uint64_t>[numPixels]);
+  valid = false;
+}
+
+void FrameReprojection::reproject(const View &newView, int refreshIndex,
+    int refreshStride, std::vector<uint8_t> &mask)
+{
+  const int w = size.x;
+  const int h = size.y;
+  mask.resize(size.long_product());
+  tasking::parallel_for(size_t(h), [&](size_t y) {
+    for (int x = 0; x < w; x++)
+      nearest[y * w + x].store(REPROJECTION_NO_PIXEL, std::memory_order_relaxed);
+  });
+
+  // forward splat, the closest source pixel wins a target pixel
+  const float duLength2 = dot(newView.du, newView.du);
+  const float dvLength2 = dot(newView.dv, newView.dv);
+  tasking::parallel_for(size_t(h), [&](size_t y) {
+    for (int x = 0; x < w; x++) {
+      const size_t i = y * w + x;
+      const float d = depth[i];
+      if (std::isinf(d))
+        continue;
+      const int neighbours[4][2] = {{x - 1, int(y)}, {x + 1, int(y)}, {x, int(y) - 1}, {x, int(y) + 1}};
+      bool edge = false;
+      for (const auto &n : neighbours) {
+        if (n[0] < 0 || n[0] >= w || n[1] < 0 || n[1] >= h)
+          continue;
+        // also true for unknown (inf) neighbours
+        edge |= !(std::abs(depth[n[1] * w + n[0]] - d) <= REPROJECTION_EDGE_TOLERANCE * d);
+      }
+      if (edge)
+        continue;
+
+      const vec3f p = view.position + d * view.rayDir(vec2f((x + 0.5f) / w, (y + 0.5f) / h));
+      const vec3f v = p - newView.position;
+      const float z = dot(v, newView.dir);
+      if (z <= 0.f)
+        continue;
+      const int tx = int(std::floor((dot(v, newView.du) / (z * duLength2) + 0.5f) * w));
+      const int ty = int(std::floor((dot(v, newView.dv) / (z * dvLength2) + 0.5f) * h));
+      if (tx < 0 || tx >= w || ty < 0 || ty >= h)
+        continue;
+
+      // positive floats order like their bits
+      const uint64_t key = (uint64_t(floatBits(length(v))) << 32) | uint64_t(i);
+      std::atomic<uint64_t> &target = nearest[ty * w + tx];
+      uint64_t current = target.load(std::memory_order_relaxed);
+      while (key < current
+             && !target.compare_exchange_weak(current, key, std::memory_order_relaxed))
+        ;
+    }
+  });
+
+  const int refreshX = refreshIndex % refreshStride;
+  const int refreshY = (refreshIndex / refreshStride) % refreshStride;
+  tasking::parallel_for(size_t(h), [&](size_t y) {
+    for (int x = 0; x < w; x++) {
+      const size_t t = y * w + x;
+      uint64_t key = nearest[t].load(std::memory_order_relaxed);
+
+      // close one pixel cracks between two warped pixels of similar depth
+      if (key == REPROJECTION_NO_PIXEL) {
+        const uint64_t pairs[2][2] = {
+          {x > 0 ? nearest[t - 1].load() : REPROJECTION_NO_PIXEL,
+           x < w - 1 ? nearest[t + 1].load() : REPROJECTION_NO_PIXEL},
+          {y > 0 ? nearest[t - w].load() : REPROJECTION_NO_PIXEL,
+           int(y) < h - 1 ? nearest[t + w].load() : REPROJECTION_NO_PIXEL}};
+        for (const auto &pair : pairs) {
+          if (pair[0] == REPROJECTION_NO_PIXEL || pair[1] == REPROJECTION_NO_PIXEL)
+            continue;
+          const float d0 = bitsFloat(pair[0] >> 32);
+          const float d1 = bitsFloat(pair[1] >> 32);
+          if (std::abs(d0 - d1) <= REPROJECTION_EDGE_TOLERANCE * std::min(d0, d1)) {
+            key = std::min(pair[0], pair[1]);
+            break;
+          }
+        }
+      }
+
+      if (key == REPROJECTION_NO_PIXEL) {
+        warpedDepth[t] = std::numeric_limits<float>::infinity();
+        mask[t] = 1;
+      } else {
+        warpedColor[t] = color[key & 0xffffffff];
+        warpedDepth[t] = bitsFloat(key >> 32);
+        mask[t] = x % refreshStride == refreshX && int(y) % refreshStride == refreshY;
+      }
+    }
+  });
+}
+
+void FrameReprojection::merge(const uint32_t *renderedColor,
+    const float *renderedDepth, const std::vector<uint8_t> &mask,
+    const View &newView)
+{
+  tasking::parallel_for(size_t(size.y), [&](size_t y) {
+    for (int x = 0; x < size.x; x++) {
+      const size_t i = y * size.x + x;
+      if (mask[i]) {
+        color[i] = renderedColor[i];
+        depth[i] = renderedDepth[i];
+      } else {
+        color[i] = warpedColor[i];
+        depth[i] = warpedDepth[i];
+      }
+    }
+  });
+  view = newView;
+  valid = true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "rkcommon/math/vec.h"
+
+// warps the last displayed frame into a moved camera with the renderer's
+// 'outputDepth', so that only the pixels the warp can not fill are traced
+class FrameReprojection{
+public:
+  // pinhole camera as ospray's "perspective" camera generates its rays
+  struct View{
+    rkcommon::math::vec3f position;
+    rkcommon::math::vec3f dir; // normalized
+    rkcommon::math::vec3f du, dv; // image plane axes at distance 1
+    static View perspective(const rkcommon::math::vec3f &position,
+			    const rkcommon::math::vec3f &direction,
+			    const rkcommon::math::vec3f &up,
+			    float fovy, float aspect);
+    // normalized ray direction through the screen position in [0, 1]
+    rkcommon::math::vec3f rayDir(const rkcommon::math::vec2f &screen) const;
+  };
+
+  rkcommon::math::vec2i size{0};
+  std::vector<uint32_t> color; // last displayed frame, 8 bit sRGBA
+  std::vector<float> depth; // ray distance per pixel, inf where unknown
+  View view;
+  bool valid = false;
+
+  void resize(const rkcommon::math::vec2i &size);
+  // warp the last frame into newView, mask is set to 1 where a pixel has
+  // to be rendered: holes, depth edges and every refreshStride^2-th pixel
+  // (offset by refreshIndex) so that the warped pixels do not drift
+  void reproject(const View &newView, int refreshIndex, int refreshStride,
+		 std::vector<uint8_t> &mask);
+  // take the rendered pixels where mask is 1 and the warped ones elsewhere,
+  // the result becomes the last frame
+  void merge(const uint32_t *renderedColor, const float *renderedDepth,
+	     const std::vector<uint8_t> &mask, const View &newView);
+
+private:
+  // nearest source pixel per target, depth bits in the high word
+  std::unique_ptr<std::atomic<uint64_t>[]> nearest;
+  std::vector<uint32_t> warpedColor;
+  std::vector<float> warpedDepth;
+};
@@ -176,6 +176,12 @@ void SegHistogram::loadImage(const char* filename){
     }
   }
 
+  delete[] image_read;
+  
+}
+
+
+void SegHistogram::printSegments() const{
   std::cout <<"\n segments loaded as:\n";
   for(auto ii=colorSegIDMap.begin(); ii!=colorSegIDMap.end(); ++ii)
     {
@@ -184,10 +190,51 @@ void SegHistogram::loadImage(const char* filename){
 		<< ii->first[2] << "} \t: \t" << ii->second << '\n';
     }
   std::cout <<" total "<<colorSegIDMap.size()<<  " segments\n\n";
-  
-  
-  delete[] image_read;
-  
+}
+
+
+void SegHistogram::setSegmentation(const HistogramSegmentation &segmentation){
+  filename.clear();
+  width = segmentation.size;
+  height = segmentation.size;
+  nChannels = 4;
+  image.resize(width*height*nChannels);
+  segImage.resize(width*height*nChannels);
+
+  // jet colors as the notebook plots them, black is reserved for invisible
+  std::vector<std::vector<int> > segColors;
+  for (int l=0; l<segmentation.numSegments; l++){
+    float v = (l+1.f)/segmentation.numSegments;
+    std::vector<int> col = {
+      int(255*std::min(std::max(1.5f - std::abs(4*v - 3), 0.f), 1.f)),
+      int(255*std::min(std::max(1.5f - std::abs(4*v - 2), 0.f), 1.f)),
+      int(255*std::min(std::max(1.5f - std::abs(4*v - 1), 0.f), 1.f))};
+    segColors.push_back(col);
+  }
+
+  for (int m=0; m<width*height; m++){
+    int label = segmentation.labels[m];
+    for (int k=0; k<3; k++)
+      image[m*nChannels + k] = label < 0 ? 0 : segColors[label][k];
+    image[m*nChannels + 3] = 255;
+  }
+  segImage = image;
+  computeDistImage();
+
+  // make color segment id map, same order as for a loaded mask
+  int color_id = 0;
+  colorSegIDMap.clear();
+  segAlphaModifier.clear();
+  for (int m=0; m<width*height; m++){
+    std::vector<int> currect_col;
+    for (int k=0; k<3; k++)
+      currect_col.push_back(int(segImage[m*nChannels + k]));
+    if (colorSegIDMap.find(currect_col) == colorSegIDMap.end() ){
+      colorSegIDMap.insert(std::make_pair(currect_col, color_id));
+      segAlphaModifier.push_back(1);
+      color_id++;
+    }
+  }
 }
 
 
@@ -244,10 +291,17 @@ void SegHistogram::loadDistImage(char* distFileName){
   int read_nChannels;
   int read_width, read_height, read_channel;
   unsigned char* image_read = stbi_load(distFileName, &read_width, &read_height, &read_nChannels, 0);
+  if (!image_read){
+    std::cerr << "no dist image "<< distFileName <<", computed from the mask\n";
+    computeDistImage();
+    return;
+  }
   if ((read_width != width) || (read_height != height)){
     // dim has to match to the segmetation image
     std::cerr << "size mismatch: "<< width <<"x"<<height <<" expected, "
-	      << read_width <<"x"<<read_height<<" read\n";
+	      << read_width <<"x"<<read_height<<" read, computed from the mask\n";
+    delete[] image_read;
+    computeDistImage();
     return;
   }else
     std::cout <<"dist image: "<<read_width <<"x"<<read_height <<"x"<<read_nChannels <<" \n";
@@ -275,6 +329,42 @@ void SegHistogram::loadDistImage(char* distFileName){
 
 }
 
+void SegHistogram::computeDistImage(){
+  // compact labels from the segment colors, black is the invisible background
+  std::map<std::vector<int>, int> colorLabels;
+  std::vector<int> labels(width*height);
+  for (int m=0; m<width*height; m++){
+    std::vector<int> col = {int(segImage[m*nChannels]),
+			    int(segImage[m*nChannels + 1]),
+			    int(segImage[m*nChannels + 2])};
+    if ((col[0] == 0) && (col[1] == 0) && (col[2] == 0)){
+      labels[m] = -1;
+      continue;
+    }
+    auto found = colorLabels.insert(std::make_pair(col, int(colorLabels.size())));
+    labels[m] = found.first->second;
+  }
+
+  std::vector<float> distances;
+  distanceToBoundary(labels, width, height, distances);
+
+  // normalized per segment, the segment core maps to 255
+  std::vector<float> maxDist(colorLabels.size(), 0.f);
+  for (int m=0; m<width*height; m++)
+    if (labels[m] >= 0)
+      maxDist[labels[m]] = std::max(maxDist[labels[m]], distances[m]);
+
+  distImage.resize(width*height*nChannels);
+  for (int m=0; m<width*height; m++){
+    int dist = 0;
+    if (labels[m] >= 0)
+      dist = maxDist[labels[m]] > 0.f ? int(255*distances[m]/maxDist[labels[m]]) : 255;
+    for (int k=0; k<3; k++)
+      distImage[m*nChannels + k] = dist;
+    distImage[m*nChannels + 3] = 255;
+  }
+}
+
 void SegHistogram::createDistImageTexture(){
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
@@ -298,10 +388,12 @@ void SegHistogram::applyDistAsAlpha(){
     std::cerr << "distance or segmentation is empty!\n";
     return;
   }
+  // the alpha is what the distance functions are evaluated at, texels of a
+  // segment are never fully transparent
   for (int i=0; i<height; i++)
       for (int j=0; j<width; j++)
-	image[i*width*nChannels + j*nChannels + 3] = 255;//distImage[i*width*nChannels + j*nChannels];
-  std::cout << "ignore distance image, apply uniform \n";
+	image[i*width*nChannels + j*nChannels + 3] =
+	  std::max(int(distImage[i*width*nChannels + j*nChannels]), 1);
 }
 
 
@@ -7,6 +7,8 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "HistogramSegmentation.h"
+
 
 #define HistImageWidth 64
 #define HistImageHeight 64
@@ -44,10 +46,16 @@ public:
   
     SegHistogram(){};
     void loadImage(const char* filename);
+    // mask and distance image from an in process segmentation
+    void setSegmentation(const HistogramSegmentation &segmentation);
+    // segment table to std::cout, not thread safe, the loaders stay silent
+    void printSegments() const;
     void createImageTexture();
     void recreateImageTexture();
   
     void loadDistImage(char* filename);
+    // per segment distance to the boundary of the current segImage
+    void computeDistImage();
     void createDistImageTexture(); // for display only
 
     void applyDistAsAlpha();
@@ -0,0 +1,253 @@
+#include "HistogramSegmentation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+
+#include "rkcommon/tasking/parallel_for.h"
+
+using namespace rkcommon;
+
+// bounds the memory for the partial histograms
+#define SEGMENTATION_MAX_TASKS 64
+#define SEGMENTATION_MIN_TASK_SIZE 65536
+
+HistogramSegmentation::HistogramSegmentation(int _size)
+{
+  size = _size;
+  numSegments = 0;
+}
+
+void HistogramSegmentation::makeHistogram(
+    const std::vector<std::vector<float> > &voxels,
+    uint32_t ch_index_0, uint32_t ch_index_1)
+{
+  const std::vector<float> &ch0 = voxels[ch_index_0];
+  const std::vector<float> &ch1 = voxels[ch_index_1];
+  const size_t numVoxels = ch0.size();
+  const size_t numTasks = std::max(size_t(1), std::min(size_t(SEGMENTATION_MAX_TASKS),
+      numVoxels / SEGMENTATION_MIN_TASK_SIZE));
+  const size_t taskSize = (numVoxels + numTasks - 1) / numTasks;
+
+  // value ranges, the renderer normalizes with the same min/max
+  std::vector<float> taskRanges(numTasks * 4);
+  tasking::parallel_for(numTasks, [&](size_t t) {
+    float range0[2] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()};
+    float range1[2] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()};
+    const size_t end = std::min(numVoxels, (t + 1) * taskSize);
+    for (size_t j = t * taskSize; j < end; j++) {
+      range0[0] = std::min(range0[0], ch0[j]);
+      range0[1] = std::max(range0[1], ch0[j]);
+      range1[0] = std::min(range1[0], ch1[j]);
+      range1[1] = std::max(range1[1], ch1[j]);
+    }
+    taskRanges[t * 4 + 0] = range0[0];
+    taskRanges[t * 4 + 1] = range0[1];
+    taskRanges[t * 4 + 2] = range1[0];
+    taskRanges[t * 4 + 3] = range1[1];
+  });
+  float range0[2] = {taskRanges[0], taskRanges[1]};
+  float range1[2] = {taskRanges[2], taskRanges[3]};
+  for (size_t t = 1; t < numTasks; t++) {
+    range0[0] = std::min(range0[0], taskRanges[t * 4 + 0]);
+    range0[1] = std::max(range0[1], taskRanges[t * 4 + 1]);
+    range1[0] = std::min(range1[0], taskRanges[t * 4 + 2]);
+    range1[1] = std::max(range1[1], taskRanges[t * 4 + 3]);
+  }
+  const float scale0 = range0[1] > range0[0] ? size / (range0[1] - range0[0]) : 0.f;
+  const float scale1 = range1[1] > range1[0] ? size / (range1[1] - range1[0]) : 0.f;
+
+  // one partial histogram per task, summed afterwards
+  std::vector<float> taskCounts(numTasks * size * size, 0.f);
+  tasking::parallel_for(numTasks, [&](size_t t) {
+    float *local = &taskCounts[t * size * size];
+    const size_t end = std::min(numVoxels, (t + 1) * taskSize);
+    for (size_t j = t * taskSize; j < end; j++) {
+      const int index_0 = std::min(std::max(int((ch0[j] - range0[0]) * scale0), 0), size - 1);
+      const int index_1 = std::min(std::max(int((ch1[j] - range1[0]) * scale1), 0), size - 1);
+      local[index_0 * size + index_1] += 1.f;
+    }
+  });
+
+  counts.assign(size * size, 0.f);
+  weights.resize(size * size);
+  tasking::parallel_for(size_t(size), [&](size_t i) {
+    for (int j = 0; j < size; j++) {
+      const int texel = i * size + j;
+      for (size_t t = 0; t < numTasks; t++)
+        counts[texel] += taskCounts[t * size * size + texel];
+      weights[texel] = counts[texel] > 0.f ? int(std::rint(std::log(counts[texel]))) : 0;
+    }
+  });
+}
+
+void HistogramSegmentation::cluster(int _numSegments, int maxIterations)
+{
+  std::vector<int> points;
+  for (int texel = 0; texel < size * size; texel++)
+    if (weights[texel] > 0)
+      points.push_back(texel);
+
+  labels.assign(size * size, -1);
+  numSegments = std::min(_numSegments, int(points.size()));
+  if (numSegments <= 0) {
+    std::cerr << "histogram is empty, nothing to segment\n";
+    distances.assign(size * size, 0.f);
+    return;
+  }
+
+  const size_t numTasks = std::min(size_t(size), points.size());
+  const size_t pointsPerTask = (points.size() + numTasks - 1) / numTasks;
+  std::vector<float> centers(numSegments * 2);
+  std::vector<float> minDist2(points.size(), std::numeric_limits<float>::max());
+
+  // k-means++ seeding, fixed seed so a segment count always gives the same mask
+  std::mt19937 rng(0);
+  for (int c = 0; c < numSegments; c++) {
+    std::vector<float> probabilities(points.size());
+    for (size_t p = 0; p < points.size(); p++)
+      probabilities[p] = weights[points[p]] * (c == 0 ? 1.f : minDist2[p]);
+    std::discrete_distribution<size_t> pick(probabilities.begin(), probabilities.end());
+    const int texel = points[pick(rng)];
+    centers[c * 2 + 0] = texel / size;
+    centers[c * 2 + 1] = texel % size;
+    tasking::parallel_for(points.size(), [&](size_t p) {
+      const float di = points[p] / size - centers[c * 2 + 0];
+      const float dj = points[p] % size - centers[c * 2 + 1];
+      minDist2[p] = std::min(minDist2[p], di * di + dj * dj);
+    });
+  }
+
+  // Lloyd iterations, assignment and partial sums in parallel over point ranges
+  std::vector<int> assignment(points.size(), -1);
+  std::vector<double> taskSums(numTasks * numSegments * 3);
+  std::vector<int> taskChanged(numTasks);
+  for (int iteration = 0; iteration < maxIterations; iteration++) {
+    std::fill(taskSums.begin(), taskSums.end(), 0.0);
+    tasking::parallel_for(numTasks, [&](size_t t) {
+      double *sums = &taskSums[t * numSegments * 3];
+      int changed = 0;
+      const size_t end = std::min(points.size(), (t + 1) * pointsPerTask);
+      for (size_t p = t * pointsPerTask; p < end; p++) {
+        const float i = points[p] / size;
+        const float j = points[p] % size;
+        int best = 0;
+        float bestDist2 = std::numeric_limits<float>::max();
+        for (int c = 0; c < numSegments; c++) {
+          const float di = i - centers[c * 2 + 0];
+          const float dj = j - centers[c * 2 + 1];
+          if (di * di + dj * dj < bestDist2) {
+            bestDist2 = di * di + dj * dj;
+            best = c;
+          }
+        }
+        changed += assignment[p] != best;
+        assignment[p] = best;
+        const int w = weights[points[p]];
+        sums[best * 3 + 0] += w * i;
+        sums[best * 3 + 1] += w * j;
+        sums[best * 3 + 2] += w;
+      }
+      taskChanged[t] = changed;
+    });
+
+    for (int c = 0; c < numSegments; c++) {
+      double sum[3] = {0.0, 0.0, 0.0};
+      for (size_t t = 0; t < numTasks; t++)
+        for (int k = 0; k < 3; k++)
+          sum[k] += taskSums[(t * numSegments + c) * 3 + k];
+      // an emptied cluster keeps its center
+      if (sum[2] > 0.0) {
+        centers[c * 2 + 0] = sum[0] / sum[2];
+        centers[c * 2 + 1] = sum[1] / sum[2];
+      }
+    }
+    if (!std::accumulate(taskChanged.begin(), taskChanged.end(), 0))
+      break;
+  }
+
+  // number segments along the diagonal so that colors stay in place when
+  // the segment count changes
+  std::vector<int> order(numSegments);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return centers[a * 2] + centers[a * 2 + 1] < centers[b * 2] + centers[b * 2 + 1];
+  });
+  std::vector<int> rank(numSegments);
+  for (int c = 0; c < numSegments; c++)
+    rank[order[c]] = c;
+  for (size_t p = 0; p < points.size(); p++)
+    labels[points[p]] = rank[assignment[p]];
+
+  computeDistances();
+}
+
+void HistogramSegmentation::computeDistances()
+{
+  distanceToBoundary(labels, size, size, distances);
+}
+
+// large but finite, inf - inf in the parabola intersection would be nan
+#define SEGMENTATION_FAR 1e20f
+
+// squared distance transform of the sampled function f (Felzenszwalb and
+// Huttenlocher), the lower envelope of the parabolas rooted at the samples
+static void distanceTransform1D(const float *f, int n, float *d, int *v, float *z)
+{
+  int k = 0;
+  v[0] = 0;
+  z[0] = -SEGMENTATION_FAR;
+  z[1] = SEGMENTATION_FAR;
+  for (int q = 1; q < n; q++) {
+    float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+    while (s <= z[k]) {
+      k--;
+      s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = SEGMENTATION_FAR;
+  }
+  k = 0;
+  for (int q = 0; q < n; q++) {
+    while (z[k + 1] < q)
+      k++;
+    d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+  }
+}
+
+void distanceToBoundary(const std::vector<int> &labels, int width, int height,
+			std::vector<float> &distances)
+{
+  distances.assign(width * height, 0.f);
+  const int numLabels = *std::max_element(labels.begin(), labels.end()) + 1;
+  std::vector<float> columns(width * height);
+
+  // one transform per label, the texels of every other label are the
+  // boundary, the border of the mask is not
+  for (int l = 0; l < numLabels; l++) {
+    tasking::parallel_for(size_t(width), [&](size_t j) {
+      std::vector<float> f(height), d(height), z(height + 1);
+      std::vector<int> v(height);
+      for (int i = 0; i < height; i++)
+        f[i] = labels[i * width + j] == l ? SEGMENTATION_FAR : 0.f;
+      distanceTransform1D(f.data(), height, d.data(), v.data(), z.data());
+      for (int i = 0; i < height; i++)
+        columns[i * width + j] = d[i];
+    });
+    tasking::parallel_for(size_t(height), [&](size_t i) {
+      std::vector<float> d(width), z(width + 1);
+      std::vector<int> v(width);
+      distanceTransform1D(&columns[i * width], width, d.data(), v.data(), z.data());
+      for (int j = 0; j < width; j++) {
+        // a label covering the whole mask has no boundary
+        if (labels[i * width + j] == l && d[j] < SEGMENTATION_FAR)
+          distances[i * width + j] = std::sqrt(d[j]);
+      }
+    });
+  }
+}
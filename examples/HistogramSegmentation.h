@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// clusters the 2d joint histogram of two channels into segments, the in
+// process counterpart of other_seg_analysis/hist_clustering.ipynb
+class HistogramSegmentation{
+public:
+  int size; // texels per axis, the renderer samples a 100x100 mask
+  std::vector<float> counts; // size x size, row from ch_index_0
+  std::vector<int> weights; // rounded log counts, 0 for empty texels
+  std::vector<int> labels; // segment per texel, -1 for empty texels
+  std::vector<float> distances; // texel distance to the segment boundary
+  int numSegments;
+
+  HistogramSegmentation(int size = 100);
+  void makeHistogram(const std::vector<std::vector<float> > &voxels,
+		     uint32_t ch_index_0, uint32_t ch_index_1);
+  // weighted k-means over the texel positions, as the notebook does
+  // over points replicated by the log count
+  void cluster(int numSegments, int maxIterations = 100);
+  void computeDistances();
+};
+
+// exact euclidean distance of every texel to the closest texel of another
+// label, 0 for labels < 0, separable and in parallel over rows and columns
+void distanceToBoundary(const std::vector<int> &labels, int width, int height,
+			std::vector<float> &distances);
@@ -10,10 +10,14 @@ struct AppParam {
     AppParam &operator=(const AppParam<T> &p) = default;
 
     AppParam(const T &p) : param(p) {}
+    // only a different value marks the param changed, so that setting
+    // the same value every frame does not cause a commit
     AppParam &operator=(const T &p)
     {
-        changed = true;
-        param = p;
+        if (!(param == p)) {
+            changed = true;
+            param = p;
+        }
         return *this;
     }
 
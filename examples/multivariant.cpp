@@ -31,14 +31,17 @@
 #include "ospray/ospray_cpp.h"
 #include "ospray/ospray_cpp/ext/rkcommon.h"
 #include "rkcommon/utility/SaveImage.h"
+#include "rkcommon/tasking/async.h"
 #include "ArcballCamera.h"
-#include "clipping_plane.h"
 #include "voxelGeneration.h"
 #include "TransferFunctionWidget.h"
 #include "Histogram.h"
+#include "FrameReprojection.h"
 #include "app_params.h"
+#include "stb_image_write.h"
 
 // stl
+#include <array>
 #include <random>
 #include <vector>
 #include <string>
@@ -46,6 +49,9 @@
 #include <ctime>
 #include <ratio>
 #include <chrono>
+#include <numeric>
+#include <future>
+#include <cstring>
 
 #define GLFW_INCLUDE_NONE
 #include <GL/glew.h>
@@ -63,6 +69,10 @@ using namespace rkcommon::math;
 vec2i imgSize{800, 600};
 vec2i windowSize{800,600};
 unsigned int texture;
+// pixel unpack buffers the frame is streamed through, one is filled while
+// the other may still be read by the previous upload
+unsigned int pixelBuffers[2];
+int pixelBufferIndex = 0;
 unsigned int guiTextures[128];
 unsigned int guiTextureSize = 0;
 
@@ -70,6 +80,9 @@ GLFWwindow *glfwWindow = nullptr;
 
 const char *imageNameString = "_100_100_%d_segs.png";
 const char *distImageNameString ="_100_100_%d_segs_dist.png";
+// range of the "number of segments" slider
+const int minNumSegments = 4;
+const int maxNumSegments = 14;
 
 static const std::vector<std::string> tfnTypeStr = {"all channel same", "evenly spaced hue"};
 static const std::vector<std::string> blendModeStr = {"add", "alpha blend", "hue preserve", "highest value dominate", "histogram weighted", "user define histogram mask"};
@@ -100,15 +113,34 @@ public:
   ospray::cpp::FrameBuffer framebuffer;
   std::unique_ptr<ArcballCamera> arcballCamera;
 
-  int tfnType = 1;
-  int blendMode = 5;
-  int frontBackBlendMode = 0;
-  int shadeMode = 0;
-  int segmentRenderMode = 0;
+  AppParam<int> tfnType{1};
+  AppParam<int> blendMode{5};
+  AppParam<int> frontBackBlendMode{0};
+  AppParam<int> shadeMode{0};
+  AppParam<int> segmentRenderMode{0};
   
-  std::vector<float> clippingBox = {0,0,0,0,0,0};
-  std::array<ClippingPlane, 6> clipping_planes;
-  AppParam<std::array<ClippingPlaneParams, 6>> clipping_params;
+  // progressive refinement while nothing changes, converged pixels stop
+  // sampling once their error is below 'pixelErrorThreshold'
+  AppParam<bool> accumulate{false};
+  AppParam<float> pixelErrorThreshold{0.f};
+
+  // CPU filter of the module run on every frame, guided by albedo and normal
+  bool denoise = false;
+  ospray::cpp::ImageOperation denoiser{"multivariantDenoiser"};
+
+  // during camera motion the last frame is warped with the renderer's
+  // 'outputDepth' and only the 'pixelMask' pixels are traced
+  AppParam<bool> reprojectionEnabled{false};
+  int reprojectionStride = 4; // every stride^2-th warped pixel is refreshed
+  int refreshIndex = 0;
+  bool cameraMoved = false;
+  FrameReprojection reprojection;
+  std::vector<float> depthImage;
+  std::vector<uint8_t> pixelMask;
+
+  // region of interest, {min, max} per axis, the renderer clamps rays to it
+  bool roiEnabled = false;
+  AppParam<std::array<float, 6>> roi{{-1, 1, -1, 1, -1, 1}};
   
   // the list of render attributes 
   std::vector<int> renderAttributesData;
@@ -125,6 +157,15 @@ public:
   std::vector<std::vector<float> >* voxel_data; // pointer to voxels data
   std::vector<Histogram> histograms; 
   SegHistogram segHist;
+  HistogramSegmentation segmentation;
+  // cluster the histogram instead of loading masks from imageFolderPath
+  bool segmentInProcess = false;
+  // decoded masks per segment count, filled on the worker pool; the slot
+  // of the shown count is empty while its mask lives in segHist
+  std::vector<SegHistogram> segVariants;
+  std::vector<std::future<void> > segVariantLoads;
+  std::vector<bool> segVariantTextures;
+  int shownSegments = minNumSegments;
   std::vector<ospray::cpp::TransferFunction> distFuncs;
   std::vector<tfnw::TransferFunctionWidget> distFnWidgets;
   int blinkCounter = 0;
@@ -132,15 +173,89 @@ public:
   bool inBlink = false;
   
   char imageFolderPath[256];
+
+  // safe to run on worker threads, only reads the shared histogram
+  void loadSegmentation(int numSegments, SegHistogram &target, bool inProcess){
+    if (inProcess){
+      HistogramSegmentation clustered = segmentation;
+      clustered.cluster(numSegments);
+      target.setSegmentation(clustered);
+    }else{
+      char filename[512], imageFixName[256];
+      sprintf(imageFixName, imageNameString, numSegments);
+      sprintf(filename, "%s%s", imageFolderPath, imageFixName);
+      target.loadImage(filename);
+      sprintf(imageFixName, distImageNameString, numSegments);
+      sprintf(filename, "%s%s", imageFolderPath, imageFixName);
+      target.loadDistImage(filename);
+    }
+    target.applyDistAsAlpha();
+  }
+
+  // decode all segment counts but the shown one in the background
+  void preloadSegmentations(){
+    for (auto &load : segVariantLoads)
+      if (load.valid())
+        load.wait();
+    const int numVariants = maxNumSegments - minNumSegments + 1;
+    segVariants.resize(numVariants);
+    segVariantLoads.resize(numVariants);
+    segVariantTextures.resize(numVariants, false);
+    segVariantTextures[shownSegments - minNumSegments] = true;
+    const bool inProcess = segmentInProcess;
+    for (int n = minNumSegments; n <= maxNumSegments; n++){
+      if (n == shownSegments)
+        continue;
+      SegHistogram *variant = &segVariants[n - minNumSegments];
+      segVariantLoads[n - minNumSegments] = rkcommon::tasking::async(
+          [=]() { loadSegmentation(n, *variant, inProcess); });
+    }
+  }
+
+  // textures can only be made on the GL thread, once the decode finished
+  void finishSegmentation(int index, bool wait){
+    std::future<void> &load = segVariantLoads[index];
+    if (!load.valid())
+      return;
+    if (!wait && load.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      return;
+    load.get();
+    if (segVariantTextures[index])
+      segVariants[index].recreateImageTexture();
+    else
+      segVariants[index].createImageTexture();
+    segVariantTextures[index] = true;
+  }
+
+  void showSegmentation(int numSegments){
+    finishSegmentation(numSegments - minNumSegments, true);
+    std::swap(segHist, segVariants[shownSegments - minNumSegments]);
+    std::swap(segHist, segVariants[numSegments - minNumSegments]);
+    shownSegments = numSegments;
+    segHist.printSegments();
+  }
   
   GLFWOSPWindow(){
     activeWindow = this;
+    denoiser.commit();
     
     /// prepare framebuffer
-    auto buffers = OSP_FB_COLOR | OSP_FB_DEPTH | OSP_FB_ACCUM | OSP_FB_ALBEDO
-      | OSP_FB_NORMAL;
-    framebuffer = ospray::cpp::FrameBuffer(imgSize.x, imgSize.y, OSP_FB_RGBA32F, buffers);
-    
+    createFramebuffer();
+  }
+
+  // 8 bit sRGB color, all that display() reads, and the denoiser's guide
+  // buffers only when it runs; exports take float images from the
+  // renderer's 'outputLayers'
+  void createFramebuffer(){
+    int channels = OSP_FB_COLOR;
+    if (accumulate.param)
+      channels |= OSP_FB_ACCUM;
+    if (denoise)
+      channels |= OSP_FB_ALBEDO | OSP_FB_NORMAL;
+    framebuffer = ospray::cpp::FrameBuffer(imgSize.x, imgSize.y, OSP_FB_SRGBA, channels);
+    if (denoise)
+      framebuffer.setParam("imageOperation", ospray::cpp::CopiedData(denoiser));
+    framebuffer.commit();
   }
   
   void display();
@@ -162,13 +277,88 @@ public:
     
   }
 
+  // objects edited during a UI frame, committed once right before rendering
+  std::vector<OSPObject> objectsToCommit;
+
+  void addObjectToCommit(OSPObject obj){
+    // keep the latest position so that dependent objects commit first
+    auto queued = std::find(objectsToCommit.begin(), objectsToCommit.end(), obj);
+    if (queued != objectsToCommit.end())
+      objectsToCommit.erase(queued);
+    objectsToCommit.push_back(obj);
+  }
+
+  void commitOutstandingObjects(){
+    for (OSPObject obj : objectsToCommit)
+      ospCommit(obj);
+    objectsToCommit.clear();
+  }
+
+  // set a renderer param only if the UI changed its value
+  template <typename T>
+  void stageRendererParam(const char *name, AppParam<T> &param){
+    if (!param.changed)
+      return;
+    param.changed = false;
+    renderer.setParam(name, param.param);
+    addObjectToCommit(renderer.handle());
+  }
+
+  // the renderer's "perspective" camera with its default fovy
+  FrameReprojection::View currentView(){
+    return FrameReprojection::View::perspective(arcballCamera->eyePos(),
+        arcballCamera->lookDir(), arcballCamera->upDir(), 60.f,
+        windowSize.x / float(windowSize.y));
+  }
+
+  void stageReprojection(){
+    if (!reprojectionEnabled.changed)
+      return;
+    reprojectionEnabled.changed = false;
+    if (reprojectionEnabled.param){
+      reprojection.resize(imgSize);
+      depthImage.assign(imgSize.long_product(), inf);
+      pixelMask.assign(imgSize.long_product(), 1);
+      renderer.setParam("outputDepth", ospray::cpp::SharedData(depthImage));
+      renderer.setParam("pixelMask", ospray::cpp::SharedData(pixelMask));
+    } else {
+      renderer.removeParam("outputDepth");
+      renderer.removeParam("pixelMask");
+      reprojection.valid = false;
+    }
+    addObjectToCommit(renderer.handle());
+  }
+
   void renderNewFrame(){
-    framebuffer.clear();
+    // any commit restarts the accumulation
+    const bool changed = !objectsToCommit.empty();
+    commitOutstandingObjects();
+    const bool reproject = reprojectionEnabled.param && cameraMoved && reprojection.valid;
+    const FrameReprojection::View view = currentView();
+    if (reprojectionEnabled.param){
+      if (reproject)
+        reprojection.reproject(view, refreshIndex++, reprojectionStride, pixelMask);
+      else
+        std::fill(pixelMask.begin(), pixelMask.end(), 1);
+    }
+    cameraMoved = false;
+
+    if (changed || !accumulate.param)
+      framebuffer.clear();
     // render one frame
-    framebuffer.renderFrame(renderer, camera, world);
+    auto frame = framebuffer.renderFrame(renderer, camera, world);
+
+    // the merged frame is what display() shows and the next warp starts from
+    if (reprojectionEnabled.param){
+      frame.wait();
+      auto fb = (const uint32_t *)framebuffer.map(OSP_FB_COLOR);
+      reprojection.merge(fb, depthImage.data(), pixelMask, view);
+      framebuffer.unmap((void *)fb);
+    }
   }
 
   void buildUI();
+  void exportBlendModeLayers();
 };
 
 GLFWOSPWindow *GLFWOSPWindow::activeWindow = nullptr;
@@ -180,29 +370,39 @@ void GLFWOSPWindow::display()
    // render textured quad with OSPRay frame buffer contents
    
    renderNewFrame();
-   auto fb = framebuffer.map(OSP_FB_COLOR);
-
-   if (1){ // weird dead pixel 
-     uint32_t testX = 133;
-     uint32_t testY = 94;
-     uint32_t testPixel = testY*imgSize.x*4 + testX*4;
-     for (int i=0; i<4; i++)
-         ((float*)fb)[testPixel+i] = ((float*)fb)[testPixel+i+4] ;
-     //((float*)fb)[testPixel] = 255;//((float*)fb)[testPixel+i+4]
-     //((float*)fb)[testPixel+1] = 255;//((float*)fb)[testPixel+i+4]
-     //((float*)fb)[testPixel+2] = 0;//((float*)fb)[testPixel+i+4]
+
+   // copy the frame into the buffer the last upload did not use, the
+   // texture is then updated from it without a sync with the driver
+   const size_t frameBytes = imgSize.long_product() * sizeof(uint32_t);
+   pixelBufferIndex = 1 - pixelBufferIndex;
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffers[pixelBufferIndex]);
+   glBufferData(GL_PIXEL_UNPACK_BUFFER, frameBytes, nullptr, GL_STREAM_DRAW);
+   uint32_t *pixels = (uint32_t *)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+   auto fb = (const uint32_t *)framebuffer.map(OSP_FB_COLOR);
+   const uint32_t *frame = reprojectionEnabled.param ? reprojection.color.data() : fb;
+   if (pixels){
+     std::memcpy(pixels, frame, frameBytes);
+
+     if (1){ // weird dead pixel 
+       uint32_t testX = 133;
+       uint32_t testY = 94;
+       uint32_t testPixel = testY*imgSize.x + testX;
+       pixels[testPixel] = frame[testPixel+1];
+     }
+     glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
    }
-   
-   glTexImage2D(GL_TEXTURE_2D,
-		0,
-		GL_RGBA32F,
-		imgSize.x,
-		imgSize.y,
-		0,
-		GL_RGBA,
-		GL_FLOAT,
-		fb);
-   framebuffer.unmap(fb);
+   framebuffer.unmap((void *)fb);
+
+   glTexSubImage2D(GL_TEXTURE_2D,
+		   0,
+		   0,
+		   0,
+		   imgSize.x,
+		   imgSize.y,
+		   GL_RGBA,
+		   GL_UNSIGNED_BYTE,
+		   nullptr);
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
    
    
    glBegin(GL_QUADS);
@@ -222,6 +422,42 @@ void GLFWOSPWindow::display()
    glEnd();
 }
 
+// render all blend modes in one traversal and write one image per mode
+void GLFWOSPWindow::exportBlendModeLayers()
+{
+  std::vector<int> modes(blendModeStr.size());
+  std::iota(modes.begin(), modes.end(), 0);
+  std::vector<vec4f> layers(modes.size() * imgSize.long_product());
+
+  renderer.setParam("outputBlendModes", ospray::cpp::CopiedData(modes));
+  renderer.setParam("outputLayers", ospray::cpp::SharedData(layers));
+  addObjectToCommit(renderer.handle());
+  renderNewFrame();
+  auto fb = framebuffer.map(OSP_FB_COLOR);
+  framebuffer.unmap(fb);
+
+  std::vector<unsigned char> image(imgSize.long_product() * 4);
+  stbi_flip_vertically_on_write(1);
+  for (size_t m = 0; m < modes.size(); m++) {
+    const vec4f *layer = layers.data() + m * imgSize.long_product();
+    for (size_t i = 0; i < size_t(imgSize.long_product()); i++) {
+      image[i*4 + 0] = clamp(layer[i].x, 0.f, 1.f) * 255;
+      image[i*4 + 1] = clamp(layer[i].y, 0.f, 1.f) * 255;
+      image[i*4 + 2] = clamp(layer[i].z, 0.f, 1.f) * 255;
+      image[i*4 + 3] = clamp(layer[i].w, 0.f, 1.f) * 255;
+    }
+    char filename[256];
+    sprintf(filename, "blendMode_%d.png", modes[m]);
+    stbi_write_png(filename, imgSize.x, imgSize.y, 4, &image[0], imgSize.x*4);
+    std::cout << "wrote to image: "<< filename<<"\n";
+  }
+  stbi_flip_vertically_on_write(0);
+
+  renderer.removeParam("outputBlendModes");
+  renderer.removeParam("outputLayers");
+  addObjectToCommit(renderer.handle());
+}
+
 bool tfnTypeUI_callback(void *, int index, const char **out_text)
 {
   *out_text = tfnTypeStr[index].c_str();
@@ -262,17 +498,31 @@ void GLFWOSPWindow::buildUI(){
   ImGuiWindowFlags flags = ImGuiWindowFlags_AlwaysAutoResize;
   ImGui::Begin("Menu Window", nullptr, flags);
   ImGui::Text("Hello from another window!");
-  static int whichtfnType = 1;
-  static int whichBlendMode = 5;
-  static int whichFrontBackBlendMode = 0;
-  static int whichShadeMode = 0;
-  static int whichSegmentRenderMode = 0;
+  int whichtfnType = tfnType.param;
+  int whichBlendMode = blendMode.param;
+  int whichFrontBackBlendMode = frontBackBlendMode.param;
+  int whichShadeMode = shadeMode.param;
+  int whichSegmentRenderMode = segmentRenderMode.param;
   static float ratio = 0.5;
-  static float alpha_scaler = 1;
+  static AppParam<float> alpha_scaler{1.f};
   static bool hist_seg_blend = false;
-  static int num_of_seg = 4;
+  static int num_of_seg = minNumSegments;
   static bool applyAllSegments;
   static bool enablePainting = false;
+  static AppParam<bool> sampleCache{false};
+  static AppParam<bool> preIntegration{false};
+  static AppParam<bool> adaptiveSampling{false};
+  static AppParam<bool> gradientVolume{false};
+  static AppParam<bool> aoVolume{false};
+  static AppParam<bool> aoVolumeRefine{false};
+  static AppParam<float> samplingRate{1.f};
+  static AppParam<int> sampleBatch{0};
+  static AppParam<bool> segmentLabels{false};
+  static AppParam<bool> segmentSkipping{false};
+
+  // pick up the segment counts decoded since the last frame
+  for (size_t i = 0; i < segVariantLoads.size(); i++)
+    finishSegmentation(i, false);
   
 	
   if (ImGui::Combo("tfn##whichtfnType",
@@ -281,8 +531,6 @@ void GLFWOSPWindow::buildUI(){
 		   nullptr,
 		   tfnTypeStr.size())) {
      tfnType = whichtfnType;
-     renderer.setParam("tfnType", tfnType); 
-     renderer.commit();
   }
 
   if (ImGui::Combo("blendMode##whichBlendMode",
@@ -291,8 +539,6 @@ void GLFWOSPWindow::buildUI(){
 		   nullptr,
 		   blendModeStr.size())) {
      blendMode = whichBlendMode;
-     renderer.setParam("blendMode", blendMode); 
-     renderer.commit();
   }
 
   if (ImGui::Combo("frontBackBlendMode##whichFrontBackBlendMode",
@@ -301,61 +547,73 @@ void GLFWOSPWindow::buildUI(){
 		   nullptr,
 		   frontBackStr.size())) {
     frontBackBlendMode = whichFrontBackBlendMode;
-    renderer.setParam("frontBackBlendMode", frontBackBlendMode); 
-    renderer.commit();
   }
  
  
-  if (ImGui::SliderFloat("scale overall opacity", &alpha_scaler, 1.000f, 50.000f)){
-    renderer.setParam("intensityModifier", alpha_scaler);
-    renderer.commit();
+  alpha_scaler.changed |= ImGui::SliderFloat("scale overall opacity", &alpha_scaler.param, 1.000f, 50.000f);
+  // re-classify cached volume samples while the camera does not move
+  sampleCache.changed |= ImGui::Checkbox("cache samples for tfn edits", &sampleCache.param);
+  // pre-integrated tfns keep sharp features at lower sampling rates
+  preIntegration.changed |= ImGui::Checkbox("pre-integrated tfns", &preIntegration.param);
+  samplingRate.changed |= ImGui::SliderFloat("volume sampling rate", &samplingRate.param, 0.0625f, 4.f);
+  // quantized gradients computed once instead of per shaded sample
+  gradientVolume.changed |= ImGui::Checkbox("precomputed gradients", &gradientVolume.param);
+  // ambient occlusion from a precomputed grid instead of AO rays
+  aoVolume.changed |= ImGui::Checkbox("ao volume", &aoVolume.param);
+  if (aoVolume.param){
+    ImGui::SameLine();
+    aoVolumeRefine.changed |= ImGui::Checkbox("refine", &aoVolumeRefine.param);
   }
-  if (ImGui::TreeNode("clipping planes")){
-    for (size_t i = 0; i < clipping_params.param.size(); ++i) {
-      ImGui::PushID(i);
-      ImGui::Separator();
-      auto &plane = clipping_params.param[i];
-
-      ImGui::Text("Clipping Plane on axis %d", plane.axis);
-      clipping_params.changed |= ImGui::Checkbox("Enabled", &plane.enabled);
-	  
-      if (ImGui::SliderFloat("Position",
-			     &clippingBox[i],
-			     -1, 1)) {
-	plane.position[plane.axis] = -clippingBox[i];
-	clipping_params.changed = true;
-      }
-
-      ImGui::PopID();
-    }
+  // longer steps through transparent or homogeneous bricks
+  adaptiveSampling.changed |= ImGui::Checkbox("adaptive sampling", &adaptiveSampling.param);
+  // mask texel per voxel, mask and segment edits only update a table
+  segmentLabels.changed |= ImGui::Checkbox("segment label volume", &segmentLabels.param);
+  // skip bricks holding only hidden segments
+  segmentSkipping.changed |= ImGui::Checkbox("skip hidden segments", &segmentSkipping.param);
+  // fetch the channels of several steps per call, 0 samples step by step
+  sampleBatch.changed |= ImGui::SliderInt("sample batch", &sampleBatch.param, 0, 8);
+  // average frames while nothing changes, converged pixels stop sampling
+  if (ImGui::Checkbox("accumulate", &accumulate.param)){
+    createFramebuffer();
+    pixelErrorThreshold.changed = true;
+  }
+  if (accumulate.param){
+    ImGui::SameLine();
+    pixelErrorThreshold.changed |= ImGui::SliderFloat("pixel error", &pixelErrorThreshold.param, 0.f, 0.1f);
+  }
+  // filter the noise of a few samples per pixel instead of accumulating
+  if (ImGui::Checkbox("denoise", &denoise))
+    createFramebuffer();
+  // warp the last frame while the camera moves, trace only what it misses
+  reprojectionEnabled.changed |= ImGui::Checkbox("reproject during motion", &reprojectionEnabled.param);
+  if (reprojectionEnabled.param){
+    ImGui::SameLine();
+    ImGui::SliderInt("refresh stride", &reprojectionStride, 1, 8);
+  }
+  if (ImGui::Button("export all blend modes"))
+    exportBlendModeLayers();
+  if (ImGui::TreeNode("region of interest")){
+    roi.changed |= ImGui::Checkbox("Enabled", &roiEnabled);
+    static const char *axisNames[3] = {"x", "y", "z"};
+    for (int a = 0; a < 3; ++a)
+      roi.changed |= ImGui::SliderFloat2(axisNames[a], &roi.param[2 * a], -1, 1);
     ImGui::TreePop();
   }
-	
-  if (clipping_params.changed) {
-    clipping_params.changed = false;
-
-    for (size_t i = 0; i < clipping_params.param.size(); ++i) {
-      clipping_planes[i].update(clipping_params.param[i]);
-      clipping_planes[i].geom.commit();
-      clipping_planes[i].model.commit();
-      clipping_planes[i].group.commit();
-      clipping_planes[i].instance.commit();
-    }
 
-    std::vector<cpp::Instance> active_instances = {instance};
-    for (auto &p : clipping_planes) {
-      if (p.params.enabled) {
-	active_instances.push_back(p.instance);
-      }
-    }
-    world.setParam("instance", cpp::CopiedData(active_instances));
-    world.commit();
+  // the box only clamps the rays, no clipping geometry to rebuild
+  if (roi.changed) {
+    roi.changed = false;
+    if (roiEnabled)
+      renderer.setParam("bbox", ospray::cpp::CopiedData(roi.param));
+    else
+      renderer.removeParam("bbox");
+    addObjectToCommit(renderer.handle());
   }
 
   ImGui::Separator();
   ImGui::Text("Blend Mode Advance Settings");
   
-  if ( blendMode < 4 ){ // add, alpha blend, hue preserve or hihest value dominate blend mode
+  if ( blendMode.param < 4 ){ // add, alpha blend, hue preserve or hihest value dominate blend mode
     if (ImGui::TreeNode("Transfer Function Selection")) 
     {
       bool renderAttributeChanged = false;
@@ -382,7 +640,7 @@ void GLFWOSPWindow::buildUI(){
 	    }
 	    tfns[n].setParam("color", ospray::cpp::CopiedData(tmpColors));
 	    tfns[n].setParam("opacity", ospray::cpp::CopiedData(tmpOpacities));
-	    tfns[n].commit();
+	    addObjectToCommit(tfns[n].handle());
 	    
 	    tfnsChanged = true;
 	  }
@@ -401,7 +659,7 @@ void GLFWOSPWindow::buildUI(){
     
 	    tfns[n].setParam("color", ospray::cpp::CopiedData(tmpColors));
 	    tfns[n].setParam("opacity", ospray::cpp::CopiedData(tmpOpacities));
-	    tfns[n].commit();
+	    addObjectToCommit(tfns[n].handle());
 
 	    tfnsChanged = true;
 	  }
@@ -419,19 +677,19 @@ void GLFWOSPWindow::buildUI(){
           }
     
           renderer.setParam("renderAttributes", ospray::cpp::CopiedData(renderAttributes));
-          renderer.commit();
+          addObjectToCommit(renderer.handle());
       }
 
       if (tfnsChanged){
           renderer.setParam("transferFunctions", ospray::cpp::CopiedData(tfns)); 
-          renderer.commit();
+          addObjectToCommit(renderer.handle());
       }
       
       ImGui::TreePop();
     }
   }      
       
-  if (blendMode == 4){
+  if (blendMode.param == 4){
     if (ImGui::TreeNode("Histogram Selection"))
     {
         for (uint32_t n = 0; n < histograms.size(); n++){
@@ -459,7 +717,7 @@ void GLFWOSPWindow::buildUI(){
                 histograms[n].ratio = ratio;
                 renderAttributesWeights[histograms[n].ch_index_0] = renderAttributesWeights[histograms[n].ch_index_1] / tan(histograms[n].ratio * M_PI/2);
                 renderer.setParam("renderAttributesWeights", ospray::cpp::CopiedData(renderAttributesWeights));
-                renderer.commit();
+                addObjectToCommit(renderer.handle());
             }
 	
             float img_k = hImgSize.y / hImgSize.x;
@@ -480,32 +738,36 @@ void GLFWOSPWindow::buildUI(){
     }
   }
   
-  if (blendMode == 5){
+  if (blendMode.param == 5){
     if (ImGui::TreeNode("External Segmentation"))
       {
-          if (ImGui::SliderInt("number of segments", &num_of_seg, 4, 14)){
-              char filename[512], imageFixName[256];
-              sprintf(imageFixName, imageNameString, num_of_seg);
-              sprintf(filename, "%s%s", imageFolderPath, imageFixName);
-              segHist.loadImage(filename);
-              sprintf(imageFixName, distImageNameString, num_of_seg);
-              sprintf(filename, "%s%s", imageFolderPath, imageFixName);
-              segHist.loadDistImage(filename);
-              segHist.applyDistAsAlpha();
+          bool segmentationChanged = false;
+          if (ImGui::SliderInt("number of segments", &num_of_seg, minNumSegments, maxNumSegments)){
+              if (hist_seg_blend)
+                  segHist.multHistAsAlpha(histograms[0], false);
+              showSegmentation(num_of_seg);
+              segmentationChanged = true;
+          }
+          if (imageFolderPath[0] && ImGui::Checkbox("cluster histogram in process", &segmentInProcess)){
+              loadSegmentation(num_of_seg, segHist, segmentInProcess);
               segHist.recreateImageTexture();
+              preloadSegmentations();
+              segmentationChanged = true;
+          }
+          if (segmentationChanged){
               hist_seg_blend = false;
 	  
+              // distance functions are only added, the renderer picks them by segment index
               distFnWidgets.resize(segHist.colorSegIDMap.size());
-              distFuncs.clear();
-              distFuncs.resize(0);
-              for (uint32_t i=0; i<segHist.colorSegIDMap.size(); i++)
-                  distFuncs.push_back(makeTransferFunctionForColor(vec2f(0.f, 1.f), vec3f(1,1,1)));
-
-              renderer.setParam("distanceFunctions", ospray::cpp::CopiedData(distFuncs));
+              if (distFuncs.size() < segHist.colorSegIDMap.size()){
+                  while (distFuncs.size() < segHist.colorSegIDMap.size())
+                      distFuncs.push_back(makeTransferFunctionForColor(vec2f(0.f, 1.f), vec3f(1,1,1)));
+                  renderer.setParam("distanceFunctions", ospray::cpp::CopiedData(distFuncs));
+              }
               renderer.setParam("segColWithAlphaModifier", ospray::cpp::CopiedData(segHist.getSegColWithAlphaModifier()));
 
               renderer.setParam("histMaskTexture", ospray::cpp::CopiedData(segHist.image));
-              renderer.commit();
+              addObjectToCommit(renderer.handle());
 	  
           }
           if (ImGui::Combo("shadeMode##whichShadeMode",
@@ -514,8 +776,6 @@ void GLFWOSPWindow::buildUI(){
                            nullptr,
                            shadeModeStr.size())) {
               shadeMode = whichShadeMode;
-              renderer.setParam("shadeMode", shadeMode); 
-              renderer.commit();
           }
 		
           if (ImGui::Combo("segmentRenderMode##whichSegmentRenderMode",
@@ -523,9 +783,7 @@ void GLFWOSPWindow::buildUI(){
                            segmentRenderModeUI_callback,
                            nullptr,
                            segmentRenderModeStr.size())) {
-              segmentRenderMode  = whichSegmentRenderMode;
-              renderer.setParam("segmentRenderMode", segmentRenderMode); 
-              renderer.commit();
+              segmentRenderMode = whichSegmentRenderMode;
           }
 
 	
@@ -576,7 +834,7 @@ void GLFWOSPWindow::buildUI(){
                   segHist.applyDistAsAlpha();
                   segHist.recreateImageTexture();
                   renderer.setParam("histMaskTexture", ospray::cpp::CopiedData(segHist.image));
-                  renderer.commit();
+                  addObjectToCommit(renderer.handle());
               }
           }
 
@@ -587,7 +845,7 @@ void GLFWOSPWindow::buildUI(){
               segHist.applyDistAsAlpha();
               segHist.recreateImageTexture();
               renderer.setParam("histMaskTexture", ospray::cpp::CopiedData(segHist.image));
-              renderer.commit();
+              addObjectToCommit(renderer.handle());
           }
 	  
 	
@@ -635,7 +893,7 @@ void GLFWOSPWindow::buildUI(){
 	    	  
           segHist.recreateImageTexture();
           renderer.setParam("histMaskTexture", ospray::cpp::CopiedData(segHist.image));
-          renderer.commit();
+          addObjectToCommit(renderer.handle());
 	  }
 	  else if (right_click && focusEnable){
           if( (colFocus[0] != colActive[0]) ||
@@ -661,7 +919,7 @@ void GLFWOSPWindow::buildUI(){
 	    	  
           segHist.recreateImageTexture();
           renderer.setParam("histMaskTexture", ospray::cpp::CopiedData(segHist.image));
-          renderer.commit();
+          addObjectToCommit(renderer.handle());
 	  }else if (left_click && enablePainting){
           std::cout << "["<<mouse_pos.x <<" "<<mouse_pos.y<<"]: " 
                     << colorPaint[0] <<" "<<colorPaint[1]<<" "<<colorPaint[2]
@@ -685,9 +943,12 @@ void GLFWOSPWindow::buildUI(){
                   }
               }
           }
+          // the painted texels move the segment boundaries
+          segHist.computeDistImage();
+          segHist.applyDistAsAlpha();
           segHist.recreateImageTexture();
           renderer.setParam("histMaskTexture", ospray::cpp::CopiedData(segHist.image));
-          renderer.commit();
+          addObjectToCommit(renderer.handle());
 	  }
 	  
 	}
@@ -710,10 +971,13 @@ void GLFWOSPWindow::buildUI(){
 	  }
 	  for (int i=0; i<3; i++)
 	    colActive[i] = colSegImage[i];
+	  // recoloring into another segment merges the two
+	  segHist.computeDistImage();
+	  segHist.applyDistAsAlpha();
 	  
 	  segHist.recreateImageTexture();
 	  renderer.setParam("histMaskTexture", ospray::cpp::CopiedData(segHist.image));
-	  renderer.commit();
+	  addObjectToCommit(renderer.handle());
 	}
 	//ImGui::SameLine();
 	unsigned int col_to_int[3] = {colActive[0]*255, colActive[1]*255, colActive[2]*255};
@@ -741,17 +1005,17 @@ void GLFWOSPWindow::buildUI(){
 
         segHist.recreateImageTexture();
         renderer.setParam("histMaskTexture", ospray::cpp::CopiedData(segHist.image));
-        renderer.commit();
+        addObjectToCommit(renderer.handle());
 	}
 
 	//
 	ImGui::Checkbox("paint mode enable", &enablePainting); ImGui::SameLine();
 	if(ImGui::SmallButton("reset image")){
 	  
-        segHist.loadImage(segHist.filename.c_str());
+        loadSegmentation(num_of_seg, segHist, segmentInProcess);
         segHist.recreateImageTexture();
         renderer.setParam("histMaskTexture", ospray::cpp::CopiedData(segHist.image));
-        renderer.commit();
+        addObjectToCommit(renderer.handle());
 	  
 	} ImGui::SameLine();
 	if(ImGui::SmallButton("saveImage")){
@@ -813,17 +1077,17 @@ void GLFWOSPWindow::buildUI(){
 		  distFnWidgets[i].alpha_control_pts = alphaOpacities;
 		  distFuncs[i].setParam("color", ospray::cpp::CopiedData(tmpColors));
 		  distFuncs[i].setParam("opacity", ospray::cpp::CopiedData(tmpOpacities));
-		  distFuncs[i].commit();
+		  addObjectToCommit(distFuncs[i].handle());
 		}
 	      }else{
 		distFuncs[l].setParam("color", ospray::cpp::CopiedData(tmpColors));
 		distFuncs[l].setParam("opacity", ospray::cpp::CopiedData(tmpOpacities));
-		distFuncs[l].commit();
+		addObjectToCommit(distFuncs[l].handle());
 	      }
 	      if (slide) renderer.setParam("segColWithAlphaModifier", ospray::cpp::CopiedData(segHist.getSegColWithAlphaModifier()));
     
 	      renderer.setParam("distanceFunctions", ospray::cpp::CopiedData(distFuncs));
-	      renderer.commit();
+	      addObjectToCommit(renderer.handle());
 	    }
 	  }
         
@@ -834,6 +1098,30 @@ void GLFWOSPWindow::buildUI(){
     }
   }
  
+
+  stageRendererParam("tfnType", tfnType);
+  stageRendererParam("blendMode", blendMode);
+  stageRendererParam("frontBackBlendMode", frontBackBlendMode);
+  stageRendererParam("shadeMode", shadeMode);
+  stageRendererParam("segmentRenderMode", segmentRenderMode);
+  stageRendererParam("intensityModifier", alpha_scaler);
+  stageRendererParam("sampleCache", sampleCache);
+  stageRendererParam("preIntegration", preIntegration);
+  stageRendererParam("volumeSamplingRate", samplingRate);
+  stageRendererParam("gradientVolume", gradientVolume);
+  stageRendererParam("aoVolume", aoVolume);
+  stageRendererParam("aoVolumeRefine", aoVolumeRefine);
+  stageRendererParam("adaptiveSampling", adaptiveSampling);
+  stageRendererParam("segmentLabels", segmentLabels);
+  stageRendererParam("segmentSkipping", segmentSkipping);
+  stageRendererParam("sampleBatch", sampleBatch);
+  // without accumulation every frame starts over, nothing can converge
+  if (pixelErrorThreshold.changed){
+    pixelErrorThreshold.changed = false;
+    renderer.setParam("pixelErrorThreshold", accumulate.param ? pixelErrorThreshold.param : 0.f);
+    addObjectToCommit(renderer.handle());
+  }
+  stageReprojection();
   ImGui::End();
   if (inBlink) blinkCounter++;
 }
@@ -868,13 +1156,12 @@ void GLFWOSPWindow::motion(double x, double y)
     }
 
     if (cameraChanged) {
-      //updateCamera();
-      //addObjectToCommit(camera.handle());
       camera.setParam("aspect", windowSize.x / float(windowSize.y));
       camera.setParam("position", arcballCamera->eyePos());
       camera.setParam("direction", arcballCamera->lookDir());
       camera.setParam("up", arcballCamera->upDir());
-      camera.commit();
+      addObjectToCommit(camera.handle());
+      cameraMoved = true;
     }
   }
 
@@ -891,11 +1178,7 @@ void GLFWOSPWindow::reshape(int w, int h)
   windowSize.y = h;
   
   // create new frame buffer
-  auto buffers = OSP_FB_COLOR | OSP_FB_DEPTH | OSP_FB_ACCUM | OSP_FB_ALBEDO
-      | OSP_FB_NORMAL;
-  framebuffer =
-    ospray::cpp::FrameBuffer(imgSize.x, imgSize.y, OSP_FB_RGBA32F, buffers);
-  framebuffer.commit();
+  createFramebuffer();
   
   glViewport(0, 0, windowSize.x, windowSize.y);
   glMatrixMode(GL_PROJECTION);
@@ -906,7 +1189,7 @@ void GLFWOSPWindow::reshape(int w, int h)
   arcballCamera->updateWindowSize(windowSize);
 
   camera.setParam("aspect", windowSize.x / float(windowSize.y));
-  camera.commit();
+  addObjectToCommit(camera.handle());
 
 }
 
@@ -921,18 +1204,27 @@ void init (void* fb){
     // set the texture wrapping/filtering options (on the currently bound texture object)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // load and generate the texture
+    // load and generate the texture, sRGB so that the blend with the
+    // sRGB framebuffer stays linear
 
     glTexImage2D(GL_TEXTURE_2D,
 		 0,
-		 GL_RGBA32F,
+		 GL_SRGB8_ALPHA8,
 		 imgSize.x,
 		 imgSize.y,
 		 0,
 		 GL_RGBA,
-		 GL_FLOAT,
+		 GL_UNSIGNED_BYTE,
 		 fb);
 
+    // display() only updates the texture through these
+    glGenBuffers(2, pixelBuffers);
+    for (int i = 0; i < 2; i++){
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffers[i]);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, imgSize.long_product() * sizeof(uint32_t), nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
 }
 
 
@@ -1039,8 +1331,8 @@ int main(int argc, const char **argv)
     return init_error;
 
   ospLoadModule("multivariant_renderer");
-  if (argc < 7) {
-      ::std::cerr << "Usage: " << argv[0] << "<filename> x y z n_of_channels <imageFolderPath>\n";
+  if (argc < 6) {
+      ::std::cerr << "Usage: " << argv[0] << "<filename> x y z n_of_channels [imageFolderPath]\n";
       return 1;
   }
   
@@ -1137,36 +1429,6 @@ int main(int argc, const char **argv)
       voxel_data.push_back(ospray::cpp::SharedData(v.data(), volumeDimensions));
     }
 
-    // clipping plane geometry
-    //glfwOspWindow.clipping_params = std::array<ClippingPlaneParams, 6>{
-    //    ClippingPlaneParams(0, vec3f(0, 0, 0)),
-    //    ClippingPlaneParams(0, vec3f(0, 0, 0)),
-    //    ClippingPlaneParams(1, vec3f(0, 0, 0)),
-    //    ClippingPlaneParams(1, vec3f(0, 0, 0)),
-    //    ClippingPlaneParams(2, vec3f(0, 0, 0)),
-    //    ClippingPlaneParams(2, vec3f(0, 0, 0))};
-    glfwOspWindow.clipping_params = std::array<ClippingPlaneParams, 6>{
-        ClippingPlaneParams(0, vec3f(0.48, 0, 0)),
-        ClippingPlaneParams(0, vec3f(-0.48, 0, 0)),
-        ClippingPlaneParams(1, vec3f(0, 0.26, 0)),
-        ClippingPlaneParams(1, vec3f(0, -0.26, 0)),
-        ClippingPlaneParams(2, vec3f(0, 0, 0.49)),
-        ClippingPlaneParams(2, vec3f(0, 0, -0.54))};
-    
-    glfwOspWindow.clipping_params.changed = false;
-    glfwOspWindow.clipping_planes = {
-        ClippingPlane(glfwOspWindow.clipping_params.param[0]),
-        ClippingPlane(glfwOspWindow.clipping_params.param[1]),
-        ClippingPlane(glfwOspWindow.clipping_params.param[2]),
-	ClippingPlane(glfwOspWindow.clipping_params.param[3]),
-        ClippingPlane(glfwOspWindow.clipping_params.param[4]),
-        ClippingPlane(glfwOspWindow.clipping_params.param[5]),
-    };
-    
-    for (int i=0; i<glfwOspWindow.clipping_params.param.size()/2; i++){
-      glfwOspWindow.clipping_params.param[i*2].flip_plane = true;
-    }
-
     // mesh geometry
     std::vector<vec3f> mesh_vertex = {vec3f(-1.0f, -1.0f, 0.0f),
 				      vec3f(-1.0f, 1.0f, 0.0f),
@@ -1259,20 +1521,15 @@ int main(int argc, const char **argv)
     h.createImageTexture();
     glfwOspWindow.histograms.push_back(h);
 
-    // load images
-    char filename[512], imageFixName[256];
-    sprintf(glfwOspWindow.imageFolderPath, "%s", argv[6]);
-    
-    sprintf(imageFixName, imageNameString, 4);
-    sprintf(filename, "%s%s", glfwOspWindow.imageFolderPath, imageFixName);
-    glfwOspWindow.segHist.loadImage(filename);
-
-    sprintf(imageFixName, distImageNameString, 4);
-    sprintf(filename, "%s%s", glfwOspWindow.imageFolderPath, imageFixName);
-    glfwOspWindow.segHist.loadDistImage(filename);
-    glfwOspWindow.segHist.applyDistAsAlpha();
+    // load segmentation masks, or cluster the histogram without an image folder
+    glfwOspWindow.segmentation.makeHistogram(voxels_read, 0, h.ch_index_1);
+    sprintf(glfwOspWindow.imageFolderPath, "%s", argc > 6 ? argv[6] : "");
+    glfwOspWindow.segmentInProcess = !glfwOspWindow.imageFolderPath[0];
+    glfwOspWindow.loadSegmentation(minNumSegments, glfwOspWindow.segHist, glfwOspWindow.segmentInProcess);
+    glfwOspWindow.segHist.printSegments();
     glfwOspWindow.segHist.createImageTexture();
     glfwOspWindow.segHist.createDistImageTexture();
+    glfwOspWindow.preloadSegmentations();
 
     glfwOspWindow.distFnWidgets.resize(glfwOspWindow.segHist.colorSegIDMap.size());
     for (uint32_t i=0; i<glfwOspWindow.segHist.colorSegIDMap.size(); i++)
@@ -1282,15 +1539,14 @@ int main(int argc, const char **argv)
     // complete setup of renderer
     renderer->setParam("aoSamples", 10);
     renderer->setParam("backgroundColor", 0.f); // white, transparent
-    renderer->setParam("blendMode", glfwOspWindow.blendMode); // 0:add color 1: alpha blend
+    renderer->setParam("blendMode", glfwOspWindow.blendMode.param); // 0:add color 1: alpha blend
     renderer->setParam("renderAttributes", ospray::cpp::CopiedData(glfwOspWindow.renderAttributesData));
     renderer->setParam("renderAttributesWeights", ospray::cpp::CopiedData(glfwOspWindow.renderAttributesWeights));
-    renderer->setParam("bbox", ospray::cpp::CopiedData(glfwOspWindow.clippingBox));
 
     renderer->setParam("histMaskTexture", ospray::cpp::CopiedData(glfwOspWindow.segHist.image));
     
     renderer->setParam("numAttributes", voxels_read.size());
-    renderer->setParam("tfnType", glfwOspWindow.tfnType); // 0:same tfn all channel 1: pick evenly on hue
+    renderer->setParam("tfnType", glfwOspWindow.tfnType.param); // 0:same tfn all channel 1: pick evenly on hue
     renderer->setParam("transferFunctions", ospray::cpp::CopiedData(glfwOspWindow.tfns));
 
     renderer->setParam("distanceFunctions", ospray::cpp::CopiedData(glfwOspWindow.distFuncs));
@@ -0,0 +1,144 @@
+// Copyright 2009-2021 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+/* Renders V overlapping multichannel volumes, one instance per ensemble
+ * member, with the multivariant renderer and reports the time per frame.
+ *
+ *   ospBenchmark_mtvVolumes [x y z] [frames]
+ *
+ * Prints one line per V = 1, 4, 16.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ospray/ospray_cpp.h"
+#include "ospray/ospray_cpp/ext/rkcommon.h"
+#include "voxelGeneration.h"
+
+using namespace rkcommon;
+using namespace rkcommon::math;
+
+static const vec2i imgSize{512, 512};
+static const int numChannels = 3;
+
+static ospray::cpp::TransferFunction makeTransferFunction(
+    const vec2f &valueRange, const vec3f &color)
+{
+  ospray::cpp::TransferFunction transferFunction("piecewiseLinear");
+  std::vector<vec3f> colors = {vec3f(0.f), color};
+  std::vector<float> opacities = {0.f, 0.2f};
+  transferFunction.setParam("color", ospray::cpp::CopiedData(colors));
+  transferFunction.setParam("opacity", ospray::cpp::CopiedData(opacities));
+  transferFunction.setParam("valueRange", valueRange);
+  transferFunction.commit();
+  return transferFunction;
+}
+
+int main(int argc, const char **argv)
+{
+  OSPError init_error = ospInit(&argc, argv);
+  if (init_error != OSP_NO_ERROR)
+    return init_error;
+
+  ospLoadModule("multivariant_renderer");
+
+  vec3i volumeDimensions(64);
+  if (argc >= 4) {
+    volumeDimensions = vec3i(
+        std::stoi(argv[1]), std::stoi(argv[2]), std::stoi(argv[3]));
+  }
+  const int numFrames = argc >= 5 ? std::stoi(argv[4]) : 16;
+
+  {
+    // the same channels for all members, only the placement differs
+    std::vector<std::vector<float>> voxels =
+        generateVoxels_nch(volumeDimensions, 10, numChannels);
+    std::vector<ospray::cpp::SharedData> voxel_data;
+    std::vector<ospray::cpp::TransferFunction> tfns;
+    std::vector<int> renderAttributes;
+    std::vector<float> renderAttributesWeights;
+    for (int i = 0; i < numChannels; i++) {
+      const auto range = std::minmax_element(voxels[i].begin(), voxels[i].end());
+      voxel_data.push_back(
+          ospray::cpp::SharedData(voxels[i].data(), volumeDimensions));
+      vec3f color(0.f);
+      color[i % 3] = 1.f;
+      tfns.push_back(
+          makeTransferFunction(vec2f(*range.first, *range.second), color));
+      renderAttributes.push_back(i);
+      renderAttributesWeights.push_back(1.f);
+    }
+    std::vector<ospray::cpp::TransferFunction> distFuncs = {
+        makeTransferFunction(vec2f(0.f, 1.f), vec3f(1.f))};
+
+    ospray::cpp::Volume volume("structuredRegular");
+    volume.setParam("gridOrigin", vec3f(-1.f));
+    volume.setParam("gridSpacing", vec3f(2.f / reduce_max(volumeDimensions)));
+    volume.setParam("data", ospray::cpp::SharedData(voxel_data));
+    volume.setParam("dimensions", volumeDimensions);
+    volume.commit();
+
+    ospray::cpp::VolumetricModel model(volume);
+    model.setParam("transferFunction", tfns[0]);
+    model.commit();
+
+    ospray::cpp::Group group;
+    group.setParam("volume", ospray::cpp::CopiedData(model));
+    group.commit();
+
+    ospray::cpp::Camera camera("perspective");
+    camera.setParam("aspect", imgSize.x / (float)imgSize.y);
+    camera.setParam("position", vec3f(0.f, 0.f, 4.f));
+    camera.setParam("direction", vec3f(0.f, 0.f, -1.f));
+    camera.setParam("up", vec3f(0.f, 1.f, 0.f));
+    camera.commit();
+
+    ospray::cpp::Renderer renderer("multivariant");
+    renderer.setParam("backgroundColor", 0.f);
+    renderer.setParam("renderAttributes", ospray::cpp::CopiedData(renderAttributes));
+    renderer.setParam("renderAttributesWeights",
+        ospray::cpp::CopiedData(renderAttributesWeights));
+    renderer.setParam("numAttributes", numChannels);
+    renderer.setParam("transferFunctions", ospray::cpp::CopiedData(tfns));
+    renderer.setParam("distanceFunctions", ospray::cpp::CopiedData(distFuncs));
+    renderer.commit();
+
+    ospray::cpp::FrameBuffer framebuffer(
+        imgSize.x, imgSize.y, OSP_FB_RGBA32F, OSP_FB_COLOR);
+
+    for (int numVolumes : {1, 4, 16}) {
+      // members shifted slightly so that all of them overlap in the middle
+      std::vector<ospray::cpp::Instance> instances;
+      for (int i = 0; i < numVolumes; i++) {
+        ospray::cpp::Instance instance(group);
+        const float offset = 0.1f * (i - 0.5f * (numVolumes - 1)) / numVolumes;
+        instance.setParam("xfm", affine3f::translate(vec3f(offset, 0.f, 0.f)));
+        instance.commit();
+        instances.push_back(instance);
+      }
+
+      ospray::cpp::World world;
+      world.setParam("instance", ospray::cpp::CopiedData(instances));
+      world.commit();
+
+      // first frame builds the acceleration structures
+      framebuffer.renderFrame(renderer, camera, world).wait();
+
+      const auto start = std::chrono::steady_clock::now();
+      for (int f = 0; f < numFrames; f++)
+        framebuffer.renderFrame(renderer, camera, world).wait();
+      const std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+      std::cout << "V = " << numVolumes << ": "
+                << elapsed.count() / numFrames << " ms/frame" << std::endl;
+    }
+  }
+
+  ospShutdown();
+  return 0;
+}
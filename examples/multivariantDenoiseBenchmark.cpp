@@ -0,0 +1,209 @@
+// Copyright 2009-2021 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+/* Renders a shaded multichannel volume with shadows at 1 spp, denoises it
+ * with the "multivariantDenoiser" image operation and reports the time
+ * accumulation needs to reach the same error against a reference.
+ *
+ *   ospBenchmark_mtvDenoise [x y z] [reference frames]
+ *
+ * The error is the RMSE of the linear color against the reference frame,
+ * accumulated over 256 frames by default.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ospray/ospray_cpp.h"
+#include "ospray/ospray_cpp/ext/rkcommon.h"
+#include "voxelGeneration.h"
+
+using namespace rkcommon;
+using namespace rkcommon::math;
+
+static const vec2i imgSize{512, 512};
+static const int numChannels = 3;
+// accumulation gives up after this many frames
+static const int maxAccumulatedFrames = 256;
+
+using Milliseconds = std::chrono::duration<double, std::milli>;
+
+static ospray::cpp::TransferFunction makeTransferFunction(
+    const vec2f &valueRange, const vec3f &color)
+{
+  ospray::cpp::TransferFunction transferFunction("piecewiseLinear");
+  std::vector<vec3f> colors = {vec3f(0.f), color};
+  std::vector<float> opacities = {0.f, 0.5f};
+  transferFunction.setParam("color", ospray::cpp::CopiedData(colors));
+  transferFunction.setParam("opacity", ospray::cpp::CopiedData(opacities));
+  transferFunction.setParam("valueRange", valueRange);
+  transferFunction.commit();
+  return transferFunction;
+}
+
+static std::vector<vec4f> readColor(ospray::cpp::FrameBuffer &framebuffer)
+{
+  auto fb = (const vec4f *)framebuffer.map(OSP_FB_COLOR);
+  std::vector<vec4f> color(fb, fb + imgSize.long_product());
+  framebuffer.unmap((void *)fb);
+  return color;
+}
+
+static double rmse(const std::vector<vec4f> &a, const std::vector<vec4f> &b)
+{
+  double sum = 0.0;
+  for (size_t i = 0; i < a.size(); i++) {
+    const vec3f d = vec3f(a[i].x, a[i].y, a[i].z) - vec3f(b[i].x, b[i].y, b[i].z);
+    sum += dot(d, d) / 3.0;
+  }
+  return std::sqrt(sum / a.size());
+}
+
+int main(int argc, const char **argv)
+{
+  OSPError init_error = ospInit(&argc, argv);
+  if (init_error != OSP_NO_ERROR)
+    return init_error;
+
+  ospLoadModule("multivariant_renderer");
+
+  vec3i volumeDimensions(64);
+  if (argc >= 4) {
+    volumeDimensions = vec3i(
+        std::stoi(argv[1]), std::stoi(argv[2]), std::stoi(argv[3]));
+  }
+  const int numReferenceFrames = argc >= 5 ? std::stoi(argv[4]) : 256;
+
+  {
+    std::vector<std::vector<float>> voxels =
+        generateVoxels_nch(volumeDimensions, 10, numChannels);
+    std::vector<ospray::cpp::SharedData> voxel_data;
+    std::vector<ospray::cpp::TransferFunction> tfns;
+    std::vector<int> renderAttributes;
+    std::vector<float> renderAttributesWeights;
+    for (int i = 0; i < numChannels; i++) {
+      const auto range = std::minmax_element(voxels[i].begin(), voxels[i].end());
+      voxel_data.push_back(
+          ospray::cpp::SharedData(voxels[i].data(), volumeDimensions));
+      vec3f color(0.f);
+      color[i % 3] = 1.f;
+      tfns.push_back(
+          makeTransferFunction(vec2f(*range.first, *range.second), color));
+      renderAttributes.push_back(i);
+      renderAttributesWeights.push_back(1.f);
+    }
+    std::vector<ospray::cpp::TransferFunction> distFuncs = {
+        makeTransferFunction(vec2f(0.f, 1.f), vec3f(1.f))};
+
+    ospray::cpp::Volume volume("structuredRegular");
+    volume.setParam("gridOrigin", vec3f(-1.f));
+    volume.setParam("gridSpacing", vec3f(2.f / reduce_max(volumeDimensions)));
+    volume.setParam("data", ospray::cpp::SharedData(voxel_data));
+    volume.setParam("dimensions", volumeDimensions);
+    volume.commit();
+
+    ospray::cpp::VolumetricModel model(volume);
+    model.setParam("transferFunction", tfns[0]);
+    model.commit();
+
+    ospray::cpp::Group group;
+    group.setParam("volume", ospray::cpp::CopiedData(model));
+    group.commit();
+
+    ospray::cpp::Instance instance(group);
+    instance.commit();
+
+    // shadow rays and the step jitter are the noise sources
+    ospray::cpp::Light ambient("ambient");
+    ambient.setParam("intensity", 0.3f);
+    ambient.commit();
+    ospray::cpp::Light sun("distant");
+    sun.setParam("direction", vec3f(-1.f, -1.f, -1.f));
+    sun.commit();
+    std::vector<ospray::cpp::Light> lights = {ambient, sun};
+
+    ospray::cpp::World world;
+    world.setParam("instance", ospray::cpp::CopiedData(instance));
+    world.setParam("light", ospray::cpp::CopiedData(lights));
+    world.commit();
+
+    ospray::cpp::Camera camera("perspective");
+    camera.setParam("aspect", imgSize.x / (float)imgSize.y);
+    camera.setParam("position", vec3f(0.f, 0.f, 4.f));
+    camera.setParam("direction", vec3f(0.f, 0.f, -1.f));
+    camera.setParam("up", vec3f(0.f, 1.f, 0.f));
+    camera.commit();
+
+    ospray::cpp::Renderer renderer("multivariant");
+    renderer.setParam("backgroundColor", 0.f);
+    renderer.setParam("renderAttributes", ospray::cpp::CopiedData(renderAttributes));
+    renderer.setParam("renderAttributesWeights",
+        ospray::cpp::CopiedData(renderAttributesWeights));
+    renderer.setParam("numAttributes", numChannels);
+    renderer.setParam("transferFunctions", ospray::cpp::CopiedData(tfns));
+    renderer.setParam("distanceFunctions", ospray::cpp::CopiedData(distFuncs));
+    renderer.setParam("shadeMode", 1);
+    renderer.setParam("shadows", true);
+    renderer.setParam("volumeSamplingRate", 0.5f);
+    renderer.commit();
+
+    ospray::cpp::ImageOperation denoiser("multivariantDenoiser");
+    denoiser.commit();
+
+    ospray::cpp::FrameBuffer accumulated(imgSize.x, imgSize.y, OSP_FB_RGBA32F,
+        OSP_FB_COLOR | OSP_FB_ACCUM);
+    ospray::cpp::FrameBuffer single(
+        imgSize.x, imgSize.y, OSP_FB_RGBA32F, OSP_FB_COLOR);
+    ospray::cpp::FrameBuffer denoised(imgSize.x, imgSize.y, OSP_FB_RGBA32F,
+        OSP_FB_COLOR | OSP_FB_ALBEDO | OSP_FB_NORMAL);
+    denoised.setParam("imageOperation", ospray::cpp::CopiedData(denoiser));
+    denoised.commit();
+
+    // first frame builds the acceleration structures
+    accumulated.renderFrame(renderer, camera, world).wait();
+
+    accumulated.clear();
+    for (int f = 0; f < numReferenceFrames; f++)
+      accumulated.renderFrame(renderer, camera, world).wait();
+    const std::vector<vec4f> reference = readColor(accumulated);
+
+    auto start = std::chrono::steady_clock::now();
+    single.renderFrame(renderer, camera, world).wait();
+    const Milliseconds renderTime = std::chrono::steady_clock::now() - start;
+    const double renderError = rmse(readColor(single), reference);
+
+    start = std::chrono::steady_clock::now();
+    denoised.renderFrame(renderer, camera, world).wait();
+    const Milliseconds denoiseTime = std::chrono::steady_clock::now() - start;
+    const double denoiseError = rmse(readColor(denoised), reference);
+
+    // reading back the frame for the error is not timed
+    accumulated.clear();
+    Milliseconds accumulationTime(0);
+    double accumulationError = renderError;
+    int frames = 0;
+    while (frames < maxAccumulatedFrames && accumulationError > denoiseError) {
+      start = std::chrono::steady_clock::now();
+      accumulated.renderFrame(renderer, camera, world).wait();
+      accumulationTime += std::chrono::steady_clock::now() - start;
+      accumulationError = rmse(readColor(accumulated), reference);
+      frames++;
+    }
+
+    std::cout << "1 spp: " << renderTime.count() << " ms, rmse "
+              << renderError << std::endl;
+    std::cout << "1 spp + denoise: " << denoiseTime.count() << " ms, rmse "
+              << denoiseError << std::endl;
+    std::cout << "accumulation: " << frames << " frames, "
+              << accumulationTime.count() << " ms, rmse " << accumulationError
+              << (accumulationError > denoiseError ? " (not reached)" : "")
+              << std::endl;
+  }
+
+  ospShutdown();
+  return 0;
+}
@@ -5,6 +5,7 @@
 
 //#include "geometry/BilinearPatches.h"
 #include "multivariant/Multivariant.h"
+#include "multivariant/WaveletDenoiser.h"
 #include "ospray/version.h"
 
 /*! _everything_ in the ospray core universe should _always_ be in the
@@ -57,6 +58,7 @@ extern "C" OSPError OSPRAY_DLLEXPORT ospray_module_init_multivariant_renderer(
     */
     //Geometry::registerType<BilinearPatches>("bilinear_patches");
     Renderer::registerType<Multivariant>("multivariant");
+    ImageOp::registerType<WaveletDenoiseFrameOp>("multivariantDenoiser");
   }
 
   return status;
@@ -3,12 +3,24 @@
 
 // ospray
 #include "Multivariant.h"
+#include "ScratchArena.h"
 #include "lights/AmbientLight.h"
+#include "lights/DirectionalLight.h"
 #include "lights/HDRILight.h"
 #include "lights/SunSkyLight.h"
+#include "common/Group.h"
+#include "common/Instance.h"
+#include "rkcommon/tasking/parallel_for.h"
 // ispc exports
 #include "common/World_ispc.h"
 #include "multivariant/Multivariant_ispc.h"
+#include "multivariant/adaptivesampling_ispc.h"
+#include "multivariant/gradients_ispc.h"
+#include "multivariant/labels_ispc.h"
+#include "multivariant/occupancy_ispc.h"
+#include "multivariant/lightinggrid_ispc.h"
+#include "multivariant/volumes_ispc.h"
+#include "multivariant/preintegration_ispc.h"
 
 namespace ospray {
 
@@ -22,10 +34,54 @@ std::string Multivariant::toString() const
   return "ospray::render::Multivariant";
 }
 
+// the contents of a data array, the flag tells whether they differ from
+// the copy of the previous commit
+template <typename T>
+static bool updateCommitted(
+    std::vector<T> &committed, const Ref<const DataT<T>> &data)
+{
+  std::vector<T> current;
+  if (data)
+    current.assign(data->begin(), data->end());
+  if (current == committed)
+    return false;
+  committed.swap(current);
+  return true;
+}
+
+// transfer functions are committed on their own, their samples tell
+// whether the classification through them changed
+static bool updateTransferFunctionSamples(
+    const std::vector<void *> &IEs, std::vector<vec4f> &committed)
+{
+  constexpr int res = 256;
+  std::vector<vec4f> current(IEs.size() * (res + 1));
+  for (size_t i = 0; i < IEs.size(); i++) {
+    ispc::Multivariant_sampleTransferFunction(
+        IEs[i], res, current.data() + i * (res + 1));
+  }
+  if (current == committed)
+    return false;
+  committed.swap(current);
+  return true;
+}
+
+template <typename T>
+static bool updateCommitted(T &committed, const T &current)
+{
+  if (current == committed)
+    return false;
+  committed = current;
+  return true;
+}
+
 void Multivariant::commit()
 {
   Renderer::commit();
 
+  // derived structures this commit rebuilds, reported for profiling
+  std::vector<const char *> rebuilt;
+
   visibleLights = getParam<bool>("visibleLights", false);
 
   renderAttributes = getParamDataT<int>("renderAttributes", false);
@@ -39,38 +95,1148 @@ void Multivariant::commit()
   if (!distFns)
     throw std::runtime_error("volumetric model must have 'distanceFunction'");
 
-  
-  tfIEs = createArrayOfIE(*tfs);
-  distFnIEs = createArrayOfIE(*distFns);
-  
-  ispc::Multivariant_set(getIE(),
-			 getParam<bool>("shadows", false),
-			 getParam<int>("aoSamples", 0),
-			 getParam<float>("aoDistance", getParam<float>("aoRadius", 1e20f)),
-			 getParam<float>("volumeSamplingRate", 1.f),
-			 getParam<int>("blendMode", 0),
-			 getParam<int>("frontBackBlendMode", 0),
-			 getParam<int>("shadeMode", 0),
-			 getParam<int>("segmentRenderMode", 0),
-			 ispc(renderAttributes),
-			 ispc(renderAttributesWeights),
-			 ispc(histMaskTexture),
-			 getParam<float>("intensityModifier", 1),
-			 getParam<int>("numAttributes", 0),
-			 getParam<int>("tfnType", 0),
-			 tfIEs.data(),
-			 distFnIEs.data(),
-			 ispc(segColWithAlphaModifier)
-			 );
+  outputBlendModes = getParamDataT<int>("outputBlendModes", false);
+  outputWeights = getParamDataT<float>("outputWeights", false);
+  outputLayers = getParamDataT<vec4f>("outputLayers", false);
+  outputDepth = getParamDataT<float>("outputDepth", false);
+  pixelMask = getParamDataT<unsigned char>("pixelMask", false);
+  // empty lists are no lists
+  if (outputBlendModes && outputBlendModes->size() == 0)
+    outputBlendModes = nullptr;
+  if (outputWeights && outputWeights->size() == 0)
+    outputWeights = nullptr;
+
+  if (outputBlendModes && outputBlendModes->size() > maxOutputLayers)
+    throw std::runtime_error("multivariant renderer supports at most "
+        + std::to_string(maxOutputLayers) + " 'outputBlendModes'");
+  if (outputBlendModes && outputWeights
+      && outputWeights->size() % outputBlendModes->size() != 0)
+    throw std::runtime_error(
+        "'outputWeights' must hold the same number of weights per layer");
+
+  // the IE arrays only follow the lists, edits of the transfer functions
+  // themselves show in their samples
+  if (updateCommitted(committedTfs, tfs)) {
+    tfIEs = tfs ? createArrayOfIE(*tfs) : std::vector<void *>();
+    rebuilt.push_back("tfIEs");
+  }
+  if (updateCommitted(committedDistFns, distFns)) {
+    distFnIEs = createArrayOfIE(*distFns);
+    rebuilt.push_back("distFnIEs");
+  }
+  const bool tfsChanged = updateTransferFunctionSamples(tfIEs, tfSamples);
+  const bool distFnsChanged =
+      updateTransferFunctionSamples(distFnIEs, distFnSamples);
+  const bool maskChanged = updateCommitted(committedMask, histMaskTexture);
+  const bool segColChanged =
+      updateCommitted(committedSegCol, segColWithAlphaModifier);
+  const bool weightsChanged =
+      updateCommitted(committedWeights, renderAttributesWeights);
+  // everything the mask classification of blend mode 5 reads
+  const bool maskClassificationChanged =
+      maskChanged || distFnsChanged || segColChanged;
+
+  const SetArguments setArguments(getParam<bool>("shadows", false),
+      getParam<int>("aoSamples", 0),
+      getParam<float>("aoDistance", getParam<float>("aoRadius", 1e20f)),
+      getParam<float>("volumeSamplingRate", 1.f),
+      getParam<int>("blendMode", 0),
+      getParam<int>("frontBackBlendMode", 0),
+      getParam<int>("shadeMode", 0),
+      getParam<int>("segmentRenderMode", 0),
+      ispc(renderAttributes),
+      ispc(renderAttributesWeights),
+      ispc(histMaskTexture),
+      getParam<float>("intensityModifier", 1),
+      getParam<int>("numAttributes", 0),
+      getParam<int>("tfnType", 0),
+      tfIEs.data(),
+      distFnIEs.data(),
+      ispc(segColWithAlphaModifier));
+  const bool settingsChanged =
+      updateCommitted(committedSetArguments, setArguments) || !setArgumentsValid;
+  setArgumentsValid = true;
+  if (settingsChanged) {
+    ispc::Multivariant_set(getIE(),
+			   std::get<0>(setArguments),
+			   std::get<1>(setArguments),
+			   std::get<2>(setArguments),
+			   std::get<3>(setArguments),
+			   std::get<4>(setArguments),
+			   std::get<5>(setArguments),
+			   std::get<6>(setArguments),
+			   std::get<7>(setArguments),
+			   ispc(renderAttributes),
+			   ispc(renderAttributesWeights),
+			   ispc(histMaskTexture),
+			   std::get<11>(setArguments),
+			   std::get<12>(setArguments),
+			   std::get<13>(setArguments),
+			   tfIEs.data(),
+			   distFnIEs.data(),
+			   ispc(segColWithAlphaModifier)
+			   );
+  }
+
+  // consecutive steps sampled per call, MULTIVARIANT_MAX_SAMPLE_BATCH at most
+  const int sampleBatch = getParam<int>("sampleBatch", 0);
+  ispc::Multivariant_setSampleBatch(
+      getIE(), sampleBatch > 1 ? std::min(sampleBatch, 8) : 0);
+
+  // region of interest as {min, max} per axis, clamps the volume rays
+  bbox = getParamDataT<float>("bbox", false);
+  box3f roi(vec3f(neg_inf), vec3f(inf));
+  if (bbox && bbox->size() == 6) {
+    const float *b = bbox->data();
+    roi = box3f(
+        vec3f(std::min(b[0], b[1]), std::min(b[2], b[3]), std::min(b[4], b[5])),
+        vec3f(std::max(b[0], b[1]), std::max(b[2], b[3]), std::max(b[4], b[5])));
+  } else if (bbox) {
+    postStatusMsg(OSP_LOG_WARNING)
+        << "multivariant: 'bbox' must hold 6 values, it is ignored";
+  }
+  const bool roiEnabled = bbox && bbox->size() == 6;
+  ispc::Multivariant_setROI(getIE(),
+      roiEnabled,
+      roi.lower.x,
+      roi.lower.y,
+      roi.lower.z,
+      roi.upper.x,
+      roi.upper.y,
+      roi.upper.z);
+
+  // pre-integrated tables let the sampling rate drop at similar quality
+  const bool preIntegration = getParam<bool>("preIntegration", false);
+  const int resolution = getParam<int>("preIntegrationResolution", 256);
+  const bool preIntegrationChanged =
+      updateCommitted(committedPreIntegration, vec2i(preIntegration, resolution));
+  if (preIntegrationChanged || tfsChanged) {
+    if (preIntegration && resolution > 1) {
+      const size_t tableSize = size_t(resolution) * resolution;
+      preIntegrationTables.resize(tfIEs.size() * tableSize);
+      tasking::parallel_for(tfIEs.size(), [&](size_t i) {
+        ispc::Multivariant_buildPreIntegrationTable(
+            tfIEs[i], resolution, preIntegrationTables.data() + i * tableSize);
+      });
+      rebuilt.push_back("preIntegrationTables");
+    } else {
+      preIntegrationTables = std::vector<vec4f>();
+    }
+  }
+
+  // matches MULTIVARIANT_HIST_MASK_SIZE in preintegration.ih
+  const size_t maskSize = 100;
+  if (preIntegrationChanged || maskClassificationChanged) {
+    if (preIntegration && histMaskTexture
+        && histMaskTexture->size() == maskSize * maskSize * 4) {
+      maskIntegrals.resize((maskSize + 1) * (maskSize + 1));
+      ispc::Multivariant_buildMaskIntegrals(getIE(), maskIntegrals.data());
+      rebuilt.push_back("maskIntegrals");
+    } else {
+      maskIntegrals = std::vector<vec4f>();
+    }
+  }
+
+  ispc::Multivariant_setPreIntegration(getIE(),
+      preIntegrationTables.empty() ? nullptr : preIntegrationTables.data(),
+      resolution,
+      maskIntegrals.empty() ? nullptr : maskIntegrals.data());
+
+  // the cached samples only depend on where the rays sample the volume,
+  // classification parameters can change freely
+  sampleCacheEnabled = getParam<bool>("sampleCache", false);
+  const int depth = std::max(getParam<int>("sampleCacheDepth", 64), 1);
+  // the cache is dropped if it would take more memory, in MB
+  sampleCacheMaxBytes =
+      size_t(std::max(getParam<int>("sampleCacheMaxMemory", 1024), 0)) << 20;
+  const float samplingRate = getParam<float>("volumeSamplingRate", 1.f);
+  std::vector<int> attributes;
+  if (renderAttributes)
+    attributes.assign(renderAttributes->begin(), renderAttributes->end());
+
+  const bool roiChanged =
+      roi.lower != sampleCacheROI.lower || roi.upper != sampleCacheROI.upper;
+  if (depth != sampleCacheDepth || samplingRate != sampleCacheSamplingRate
+      || attributes != sampleCacheAttributes || roiChanged) {
+    sampleCacheDepth = depth;
+    sampleCacheSamplingRate = samplingRate;
+    sampleCacheAttributes = attributes;
+    sampleCacheROI = roi;
+    invalidateSampleCache();
+    rebuilt.push_back("sampleCache");
+  }
+
+  // anything the classification of a sample reads, the step sizes and the
+  // extinction follow it
+  const bool classificationTableChanged =
+      updateCommitted(committedClassificationChannels,
+          getParamDataT<int>("classificationChannels", false))
+      | updateCommitted(committedClassificationCells,
+          getParamDataT<int>("classificationCells", false))
+      | updateCommitted(committedClassificationColors,
+          getParamDataT<vec4f>("classificationColors", false))
+      | updateCommitted(committedClassificationResolution,
+          getParam<int>("classificationResolution", 32))
+      | updateCommitted(committedNumAttributes, int(attributes.size()));
+  const bool classificationChanged = settingsChanged || tfsChanged
+      || maskClassificationChanged || weightsChanged || preIntegrationChanged
+      || classificationTableChanged;
+
+  // brick ranges depend on the rendered channels, the step sizes also on
+  // the classification and are recomputed with the next frame
+  adaptiveSampling = getParam<bool>("adaptiveSampling", false);
+  const float threshold = getParam<float>("adaptiveThreshold", 0.02f);
+  const float maxStepScale =
+      std::max(getParam<float>("adaptiveMaxStepScale", 4.f), 1.f);
+  const int gridResolution =
+      std::max(getParam<int>("adaptiveGridResolution", 64), 1);
+  if (attributes != stepGridAttributes
+      || gridResolution != adaptiveGridResolution) {
+    stepGridAttributes = attributes;
+    adaptiveGridResolution = gridResolution;
+    stepGrids.clear();
+  }
+  if (classificationChanged || threshold != adaptiveThreshold
+      || maxStepScale != adaptiveMaxStepScale) {
+    adaptiveThreshold = threshold;
+    adaptiveMaxStepScale = maxStepScale;
+    stepScalesValid = false;
+  }
+
+  gradientVolume = getParam<bool>("gradientVolume", false);
+
+  // pixels whose estimated error fell below the threshold stop sampling,
+  // 0 samples every pixel in every frame
+  pixelErrorThreshold = getParam<float>("pixelErrorThreshold", 0.f);
+  pixelMinSamples = std::max(getParam<int>("pixelMinSamples", 4), 2);
+
+  if (classificationTableChanged) {
+    buildClassificationTable();
+    rebuilt.push_back("classificationTable");
+  }
+
+  // labels only depend on the two mask channels, everything else the mask
+  // classification uses goes into the label table
+  segmentLabels = getParam<bool>("segmentLabels", false);
+  const bool labelTableUsed = segmentLabels && attributes.size() >= 2
+      && histMaskTexture
+      && histMaskTexture->size() == maskSize * maskSize * 4;
+  if (labelTableUsed != !labelTable.empty()
+      || (labelTableUsed && maskClassificationChanged)) {
+    if (labelTableUsed) {
+      labelTable.resize(maskSize * maskSize + 1);
+      ispc::Multivariant_buildLabelTable(getIE(), labelTable.data());
+      rebuilt.push_back("labelTable");
+    } else {
+      labelTable = std::vector<vec4f>();
+    }
+  }
+  const std::vector<int> labelAttributes(attributes.begin(),
+      attributes.begin() + std::min(attributes.size(), size_t(2)));
+  if (labelAttributes != labelGridAttributes) {
+    labelGridAttributes = labelAttributes;
+    labelGrids.clear();
+  }
+
+  // bricks are skipped by the mask cells they hold, only where blend mode 5
+  // classifies by the mask alone; visibility edits only redo the matching
+  const int blendMode = getParam<int>("blendMode", 0);
+  bool layersMaskOnly = true;
+  if (outputBlendModes) {
+    for (int mode : *outputBlendModes)
+      layersMaskOnly &= mode == 5;
+  }
+  const bool skipping = getParam<bool>("segmentSkipping", false)
+      && blendMode == 5 && layersMaskOnly && getParam<int>("tfnType", 0) == 1
+      && attributes.size() >= 2
+      && !(attributes.size() > 2 && getParam<int>("segmentRenderMode", 0) == 1)
+      && histMaskTexture
+      && histMaskTexture->size() == maskSize * maskSize * 4;
+  if (skipping && (!segmentSkipping || maskClassificationChanged)) {
+    // matches MULTIVARIANT_OCCUPANCY_WORDS in occupancy.ih
+    std::vector<uint32_t> cells(8);
+    ispc::Multivariant_computeVisibleCells(getIE(), cells.data());
+    if (updateCommitted(visibleCells, cells)) {
+      occupancyValid = false;
+      rebuilt.push_back("visibleCells");
+    }
+  }
+  segmentSkipping = skipping;
+  const int occupancyResolution =
+      std::max(getParam<int>("occupancyGridResolution", 64), 1);
+  if (labelAttributes != occupancyGridAttributes
+      || occupancyResolution != occupancyGridResolution) {
+    occupancyGridAttributes = labelAttributes;
+    occupancyGridResolution = occupancyResolution;
+    occupancyGrids.clear();
+  }
+
+  // the extinction follows the classification, recompute it next frame
+  const bool lightingChanged =
+      updateCommitted(shadowsEnabled, getParam<bool>("shadows", false))
+      | updateCommitted(shadowGridEnabled, getParam<bool>("shadowGrid", false))
+      | updateCommitted(aoVolumeEnabled, getParam<bool>("aoVolume", false))
+      | updateCommitted(aoVolumeRefine, getParam<bool>("aoVolumeRefine", false))
+      | updateCommitted(aoSamples, getParam<int>("aoSamples", 0))
+      | updateCommitted(aoRadius,
+          getParam<float>("aoDistance", getParam<float>("aoRadius", 1e20f)))
+      | updateCommitted(lightingGridResolution,
+          std::max(getParam<int>("lightingGridResolution",
+                       getParam<int>("shadowGridResolution", 64)),
+              2));
+  if (classificationChanged || lightingChanged || roiChanged)
+    extinctionValid = false;
+
+  if (!rebuilt.empty()) {
+    std::string names;
+    for (const char *name : rebuilt)
+      names += std::string(" ") + name;
+    postStatusMsg(OSP_LOG_DEBUG) << "multivariant: commit rebuilt" << names;
+  }
+}
+
+// home slot of a key, matches classificationSlot() in classification.ih
+static inline uint32_t classificationSlot(uint32_t key, int capacityLog2)
+{
+  return (key * 2654435761u) >> (32 - capacityLog2);
+}
+
+void Multivariant::buildClassificationTable()
+{
+  // cells listed as one bin per channel each, with a color and opacity
+  auto channels = getParamDataT<int>("classificationChannels", false);
+  auto cells = getParamDataT<int>("classificationCells", false);
+  auto colors = getParamDataT<vec4f>("classificationColors", false);
+  const int resolution = getParam<int>("classificationResolution", 32);
+
+  classificationChannels.clear();
+  classificationKeys = std::vector<uint32_t>();
+  classificationValues = std::vector<vec4f>();
+  classificationCapacityLog2 = 0;
+  if (channels && cells && colors) {
+    const int numChannels = channels->size();
+    const int numAttributes = renderAttributes ? renderAttributes->size() : 0;
+    bool valid = numChannels >= 1 && numChannels <= 4 && resolution >= 1
+        && resolution <= 255 && cells->size() == colors->size() * numChannels;
+    for (int c : *channels)
+      valid &= c >= 0 && c < numAttributes;
+    if (!valid) {
+      postStatusMsg(OSP_LOG_WARNING)
+          << "multivariant: 'classificationChannels' must list 1-4 of the "
+             "'renderAttributes' with 'classificationResolution' <= 255 and "
+             "one bin per channel in 'classificationCells' for every "
+             "'classificationColors' entry, the table is disabled";
+    } else {
+      classificationChannels.assign(channels->begin(), channels->end());
+    }
+  }
+
+  if (!classificationChannels.empty()) {
+    // open addressing at a load factor of at most one half
+    const size_t numCells = colors->size();
+    classificationCapacityLog2 = 1;
+    while ((size_t(1) << classificationCapacityLog2) < 2 * numCells)
+      classificationCapacityLog2++;
+    const uint32_t mask = (1u << classificationCapacityLog2) - 1;
+    classificationKeys.assign(mask + 1, 0xffffffff);
+    classificationValues.assign(mask + 1, vec4f(0.f));
+
+    const int numChannels = classificationChannels.size();
+    const int *bins = cells->data();
+    for (size_t i = 0; i < numCells; i++) {
+      uint32_t key = 0;
+      for (int c = 0; c < numChannels; c++) {
+        const int bin = std::min(std::max(bins[i * numChannels + c], 0),
+            resolution - 1);
+        key |= uint32_t(bin) << (8 * c);
+      }
+      uint32_t slot = classificationSlot(key, classificationCapacityLog2);
+      while (classificationKeys[slot] != 0xffffffff
+          && classificationKeys[slot] != key)
+        slot = (slot + 1) & mask;
+      classificationKeys[slot] = key;
+      classificationValues[slot] = (*colors)[i];
+    }
+  }
+
+  classificationResolution = resolution;
+  ispc::Multivariant_setClassificationTable(getIE(),
+      classificationChannels.size(),
+      classificationChannels.data(),
+      classificationResolution,
+      classificationCapacityLog2,
+      classificationKeys.empty() ? nullptr : classificationKeys.data(),
+      classificationValues.empty() ? nullptr : classificationValues.data());
+}
+
+void Multivariant::updateOutputLayers(FrameBuffer *fb)
+{
+  const int numLayers = outputBlendModes ? outputBlendModes->size() : 0;
+  const bool weighted = outputWeights && outputWeights->size() > 0;
+
+  // the application shares the layer memory, one image per blend mode
+  vec4f *layers = nullptr;
+  if (numLayers > 0 && outputLayers) {
+    const size_t numPixels = fb->getNumPixels().long_product();
+    if (outputLayers->size() == numLayers * numPixels) {
+      layers = const_cast<vec4f *>(outputLayers->data());
+    } else {
+      postStatusMsg(OSP_LOG_WARNING)
+          << "multivariant: 'outputLayers' must hold " << numLayers << "x"
+          << numPixels << " pixels, output layers are disabled";
+    }
+  }
+
+  ispc::Multivariant_setOutputLayers(getIE(),
+      layers ? numLayers : 0,
+      layers ? const_cast<int *>(outputBlendModes->data()) : nullptr,
+      layers && weighted ? const_cast<float *>(outputWeights->data())
+                         : nullptr,
+      layers && weighted ? outputWeights->size() / numLayers : 0,
+      layers);
+}
+
+void Multivariant::updateOutputDepth(FrameBuffer *fb)
+{
+  // the application shares the depth image, used to reproject the frame
+  float *depth = nullptr;
+  if (outputDepth) {
+    const size_t numPixels = fb->getNumPixels().long_product();
+    if (outputDepth->size() == numPixels) {
+      depth = const_cast<float *>(outputDepth->data());
+    } else {
+      postStatusMsg(OSP_LOG_WARNING)
+          << "multivariant: 'outputDepth' must hold " << numPixels
+          << " pixels, depth output is disabled";
+    }
+  }
+
+  ispc::Multivariant_setOutputDepth(getIE(), depth);
+}
+
+void Multivariant::updatePixelMask(FrameBuffer *fb)
+{
+  // shared as well, the application updates it between frames
+  unsigned char *mask = nullptr;
+  if (pixelMask) {
+    const size_t numPixels = fb->getNumPixels().long_product();
+    if (pixelMask->size() == numPixels) {
+      mask = const_cast<unsigned char *>(pixelMask->data());
+    } else {
+      postStatusMsg(OSP_LOG_WARNING)
+          << "multivariant: 'pixelMask' must hold " << numPixels
+          << " pixels, all pixels are rendered";
+    }
+  }
+
+  ispc::Multivariant_setPixelMask(getIE(), mask);
+}
+
+void Multivariant::updatePixelStatistics(FrameBuffer *fb)
+{
+  if (pixelErrorThreshold <= 0.f || !fb) {
+    if (!pixelMeans.empty()) {
+      pixelMeans = std::vector<vec4f>();
+      pixelErrors = std::vector<vec2f>();
+    }
+    ispc::Multivariant_setPixelStatistics(getIE(), 0.f, 0, nullptr, nullptr);
+    return;
+  }
+
+  // the first frame of an accumulation resets the statistics of a pixel,
+  // zeros also read as no samples in a frame buffer that is already
+  // accumulating
+  const size_t numPixels = fb->getNumPixels().long_product();
+  if (pixelMeans.size() != numPixels) {
+    pixelMeans.assign(numPixels, vec4f(0.f));
+    pixelErrors.assign(numPixels, vec2f(0.f));
+  }
+
+  ispc::Multivariant_setPixelStatistics(getIE(),
+      pixelErrorThreshold,
+      pixelMinSamples,
+      pixelMeans.data(),
+      pixelErrors.data());
+}
+
+void Multivariant::updateStepGrids(World *world)
+{
+  if (!adaptiveSampling || stepGridAttributes.empty()) {
+    if (!stepGrids.empty()) {
+      stepGrids = std::vector<StepGrid>();
+      stepGridWorld = nullptr;
+    }
+    ispc::Multivariant_setStepGrids(getIE(), 0, nullptr, nullptr, nullptr);
+    return;
+  }
+
+  // lattice samples per brick edge, bricks are sampled on their faces too
+  constexpr int brickSamples = 8;
+  const int numChannels = stepGridAttributes.size();
+
+  // a recommitted world may have changed the volumes
+  if (world != stepGridWorld || !world->scivisDataValid || stepGrids.empty()) {
+    stepGridWorld = world;
+    stepGrids.clear();
+    if (world->instances) {
+      for (auto &&instance : *world->instances) {
+        if (!instance->group->volumetricModels)
+          continue;
+        for (auto &&model : *instance->group->volumetricModels) {
+          auto found = std::find_if(stepGrids.begin(),
+              stepGrids.end(),
+              [&](const StepGrid &g) { return g.model == model; });
+          if (found != stepGrids.end())
+            continue;
+
+          // cubic bricks, 'adaptiveGridResolution' along the longest axis
+          const vec3f extent = model->bounds().size();
+          const float brickSize = reduce_max(extent) / adaptiveGridResolution;
+          StepGrid grid;
+          grid.model = model;
+          grid.dims = vec3i(std::max(int(std::ceil(extent.x / brickSize)), 1),
+              std::max(int(std::ceil(extent.y / brickSize)), 1),
+              std::max(int(std::ceil(extent.z / brickSize)), 1));
+          stepGrids.push_back(std::move(grid));
+        }
+      }
+    }
+
+    for (auto &grid : stepGrids) {
+      const int numBricks = grid.dims.long_product();
+      const int numTasks = (numBricks + 63) / 64;
+      grid.ranges.resize(size_t(numBricks) * numChannels);
+      tasking::parallel_for(numTasks, [&](int task) {
+        ispc::Multivariant_computeBrickRanges(grid.model->getIE(),
+            grid.dims.x,
+            grid.dims.y,
+            grid.dims.z,
+            brickSamples,
+            numChannels,
+            stepGridAttributes.data(),
+            task * 64,
+            std::min(task * 64 + 64, numBricks),
+            grid.ranges.data());
+      });
+    }
+    stepScalesValid = false;
+  }
+
+  if (!stepScalesValid) {
+    stepGridModels.clear();
+    stepGridDims.clear();
+    stepGridScales.clear();
+    for (auto &grid : stepGrids) {
+      const int numBricks = grid.dims.long_product();
+      const int numTasks = (numBricks + 1023) / 1024;
+      grid.scales.resize(numBricks);
+      tasking::parallel_for(numTasks, [&](int task) {
+        ispc::Multivariant_computeStepScales(getIE(),
+            grid.model->getIE(),
+            numChannels,
+            grid.ranges.data(),
+            task * 1024,
+            std::min(task * 1024 + 1024, numBricks),
+            adaptiveThreshold,
+            adaptiveMaxStepScale,
+            grid.scales.data());
+      });
+      stepGridModels.push_back(grid.model->getIE());
+      stepGridDims.push_back(grid.dims.x);
+      stepGridDims.push_back(grid.dims.y);
+      stepGridDims.push_back(grid.dims.z);
+      stepGridScales.push_back(grid.scales.data());
+    }
+    stepScalesValid = true;
+  }
+
+  ispc::Multivariant_setStepGrids(getIE(),
+      stepGridModels.size(),
+      stepGridModels.data(),
+      stepGridDims.data(),
+      stepGridScales.data());
+}
+
+void Multivariant::updateGradientGrids(World *world)
+{
+  if (!gradientVolume) {
+    if (!gradientGrids.empty()) {
+      gradientGrids = std::vector<GradientGrid>();
+      gradientGridWorld = nullptr;
+    }
+    ispc::Multivariant_setGradientGrids(
+        getIE(), 0, nullptr, nullptr, nullptr);
+    return;
+  }
+
+  // gradients only change with the volumes
+  if (world != gradientGridWorld || !world->scivisDataValid) {
+    gradientGridWorld = world;
+    gradientGrids.clear();
+    gradientGridModels.clear();
+    gradientGridDims.clear();
+    gradientGridCodes.clear();
+    if (world->instances) {
+      for (auto &&instance : *world->instances) {
+        if (!instance->group->volumetricModels)
+          continue;
+        for (auto &&model : *instance->group->volumetricModels) {
+          auto found = std::find_if(gradientGrids.begin(),
+              gradientGrids.end(),
+              [&](const GradientGrid &g) { return g.model == model; });
+          if (found != gradientGrids.end())
+            continue;
+
+          // one node per voxel, volumes without 'dimensions' get 128 nodes
+          // along the longest axis
+          GradientGrid grid;
+          grid.model = model;
+          grid.dims =
+              model->getVolume()->getParam<vec3i>("dimensions", vec3i(0));
+          if (reduce_min(grid.dims) < 2) {
+            const vec3f extent = model->bounds().size();
+            const float spacing = reduce_max(extent) / 127.f;
+            grid.dims = vec3i(std::max(int(extent.x / spacing) + 1, 2),
+                std::max(int(extent.y / spacing) + 1, 2),
+                std::max(int(extent.z / spacing) + 1, 2));
+          }
+          gradientGrids.push_back(std::move(grid));
+        }
+      }
+    }
+
+    for (auto &grid : gradientGrids) {
+      grid.codes.resize(grid.dims.long_product());
+      tasking::parallel_for(grid.dims.z, [&](int z) {
+        ispc::Multivariant_computeGradientGrid(grid.model->getIE(),
+            grid.dims.x,
+            grid.dims.y,
+            grid.dims.z,
+            z,
+            z + 1,
+            grid.codes.data());
+      });
+      gradientGridModels.push_back(grid.model->getIE());
+      gradientGridDims.push_back(grid.dims.x);
+      gradientGridDims.push_back(grid.dims.y);
+      gradientGridDims.push_back(grid.dims.z);
+      gradientGridCodes.push_back(grid.codes.data());
+    }
+  }
+
+  ispc::Multivariant_setGradientGrids(getIE(),
+      gradientGridModels.size(),
+      gradientGridModels.data(),
+      gradientGridDims.data(),
+      gradientGridCodes.data());
+}
+
+void Multivariant::updateLightingGrids(World *world)
+{
+  // direction to every light in the order of the scivis light list, zero
+  // for lights that keep tracing shadow rays
+  std::vector<vec3f> toLights;
+  bool anyDirectional = false;
+  if (shadowsEnabled && shadowGridEnabled && world->lights) {
+    for (auto &&light : *world->lights) {
+      if (dynamic_cast<const AmbientLight *>(light)
+          || dynamic_cast<const HDRILight *>(light))
+        continue;
+
+      vec3f toLight(0.f);
+      if (dynamic_cast<const SunSkyLight *>(light)) {
+        toLight = -normalize(
+            light->getParam<vec3f>("direction", vec3f(0.f, -1.f, 0.f)));
+      } else if (dynamic_cast<const DirectionalLight *>(light)) {
+        toLight = -normalize(
+            light->getParam<vec3f>("direction", vec3f(0.f, 0.f, 1.f)));
+      }
+      anyDirectional |= toLight != vec3f(0.f);
+      toLights.push_back(toLight);
+    }
+  }
+  const bool needAO = aoVolumeEnabled && aoSamples > 0;
+
+  if ((anyDirectional || needAO)
+      && (world != lightingGridWorld || !world->scivisDataValid
+          || !extinctionValid)) {
+    std::vector<void *> instances;
+    std::vector<void *> models;
+    box3f bounds = empty;
+    if (world->instances) {
+      for (auto &&instance : *world->instances) {
+        if (!instance->group->volumetricModels)
+          continue;
+        for (auto &&model : *instance->group->volumetricModels) {
+          box3f box;
+          ispc::Multivariant_getVolumeWorldBounds(
+              instance->getIE(), model->getIE(), &box.lower.x);
+          bounds.extend(box);
+          instances.push_back(instance->getIE());
+          models.push_back(model->getIE());
+        }
+      }
+    }
+
+    extinction.clear();
+    if (!models.empty()) {
+      // cubic cells, 'lightingGridResolution' nodes along the longest axis
+      const vec3f extent = bounds.size();
+      const float spacing = reduce_max(extent) / (lightingGridResolution - 1);
+      lightingGridBounds = bounds;
+      lightingGridDims = vec3i(std::max(int(extent.x / spacing) + 1, 2),
+          std::max(int(extent.y / spacing) + 1, 2),
+          std::max(int(extent.z / spacing) + 1, 2));
+      extinction.resize(lightingGridDims.long_product());
+      tasking::parallel_for(lightingGridDims.z, [&](int z) {
+        ispc::Multivariant_computeShadowExtinction(getIE(),
+            models.size(),
+            instances.data(),
+            models.data(),
+            bounds.lower.x,
+            bounds.lower.y,
+            bounds.lower.z,
+            bounds.upper.x,
+            bounds.upper.y,
+            bounds.upper.z,
+            lightingGridDims.x,
+            lightingGridDims.y,
+            lightingGridDims.z,
+            z,
+            z + 1,
+            extinction.data());
+      });
+    }
+    lightingGridWorld = world;
+    extinctionValid = true;
+    // propagated from the old extinction, possibly at other dimensions
+    clearShadowGrids();
+    aoGrid.clear();
+  }
+
+  if (!(anyDirectional || needAO) || extinction.empty()) {
+    if (!extinction.empty() || !shadowGrids.empty() || !aoGrid.empty()) {
+      extinction = std::vector<float>();
+      clearShadowGrids();
+      aoGrid = std::vector<float>();
+      lightingGridWorld = nullptr;
+    }
+    ispc::Multivariant_setLightingGrids(getIE(),
+        0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0, 0, 0,
+        nullptr, nullptr, nullptr);
+    return;
+  }
+
+  // propagate from every light whose direction changed
+  if (toLights.empty()) {
+    clearShadowGrids();
+  } else if (toLights != shadowGridLights) {
+    shadowGrids.resize(toLights.size());
+    tasking::parallel_for(toLights.size(), [&](size_t i) {
+      const vec3f &toLight = toLights[i];
+      if (toLight == vec3f(0.f)) {
+        shadowGrids[i] = std::vector<float>();
+        return;
+      }
+      if (i < shadowGridLights.size() && shadowGridLights[i] == toLight
+          && !shadowGrids[i].empty())
+        return;
+      shadowGrids[i].resize(extinction.size());
+      ispc::Multivariant_propagateShadowGrid(lightingGridBounds.lower.x,
+          lightingGridBounds.lower.y,
+          lightingGridBounds.lower.z,
+          lightingGridBounds.upper.x,
+          lightingGridBounds.upper.y,
+          lightingGridBounds.upper.z,
+          lightingGridDims.x,
+          lightingGridDims.y,
+          lightingGridDims.z,
+          toLight.x,
+          toLight.y,
+          toLight.z,
+          extinction.data(),
+          shadowGrids[i].data());
+    });
+    shadowGridLights = toLights;
+
+    shadowGridPointers.clear();
+    lightShadowGrids.clear();
+    for (auto &grid : shadowGrids) {
+      lightShadowGrids.push_back(grid.empty() ? -1 : shadowGridPointers.size());
+      if (!grid.empty())
+        shadowGridPointers.push_back(grid.data());
+    }
+  }
+
+  if (!needAO) {
+    aoGrid = std::vector<float>();
+  } else if (aoGrid.empty()) {
+    computeAOGrid();
+  }
+
+  ispc::Multivariant_setLightingGrids(getIE(),
+      lightingGridBounds.lower.x,
+      lightingGridBounds.lower.y,
+      lightingGridBounds.lower.z,
+      lightingGridBounds.upper.x,
+      lightingGridBounds.upper.y,
+      lightingGridBounds.upper.z,
+      lightingGridDims.x,
+      lightingGridDims.y,
+      lightingGridDims.z,
+      lightShadowGrids.empty() ? nullptr : lightShadowGrids.data(),
+      shadowGridPointers.empty() ? nullptr : shadowGridPointers.data(),
+      aoGrid.empty() ? nullptr : aoGrid.data());
+}
+
+void Multivariant::clearShadowGrids()
+{
+  shadowGrids = std::vector<std::vector<float>>();
+  shadowGridLights.clear();
+  lightShadowGrids.clear();
+  shadowGridPointers.clear();
+}
+
+void Multivariant::computeAOGrid()
+{
+  // AO is local, an unbounded radius is limited to a quarter of the grid
+  const vec3f extent = lightingGridBounds.size();
+  const float spacing = reduce_max(extent) / (lightingGridResolution - 1);
+  const float radius = std::min(aoRadius, 0.25f * reduce_max(extent));
+
+  // extinction pyramid, halving the resolution per level until the cells
+  // reach the AO radius
+  std::vector<std::vector<float>> levels;
+  std::vector<int> levelDims;
+  const float *fine = extinction.data();
+  vec3i fineDims = lightingGridDims;
+  levelDims.insert(levelDims.end(), {fineDims.x, fineDims.y, fineDims.z});
+  for (float reach = spacing; reach < radius && reduce_max(fineDims) > 2;
+       reach *= 2.f) {
+    const vec3i coarseDims = vec3i((fineDims.x + 2) / 2,
+        (fineDims.y + 2) / 2,
+        (fineDims.z + 2) / 2);
+    levels.emplace_back(coarseDims.long_product());
+    float *coarse = levels.back().data();
+    tasking::parallel_for(coarseDims.z, [&](int z) {
+      ispc::Multivariant_downsampleExtinction(fineDims.x,
+          fineDims.y,
+          fineDims.z,
+          fine,
+          coarseDims.x,
+          coarseDims.y,
+          z,
+          z + 1,
+          coarse);
+    });
+    levelDims.insert(levelDims.end(), {coarseDims.x, coarseDims.y, coarseDims.z});
+    fine = coarse;
+    fineDims = coarseDims;
+  }
+
+  std::vector<const float *> levelPointers{extinction.data()};
+  for (auto &level : levels)
+    levelPointers.push_back(level.data());
+
+  aoGrid.resize(extinction.size());
+  tasking::parallel_for(lightingGridDims.z, [&](int z) {
+    ispc::Multivariant_computeAOGrid(levelPointers.size(),
+        levelPointers.data(),
+        levelDims.data(),
+        spacing,
+        radius,
+        z,
+        z + 1,
+        aoGrid.data());
+  });
+
+  if (aoVolumeRefine) {
+    const int dims[3] = {lightingGridDims.x, lightingGridDims.y, lightingGridDims.z};
+    tasking::parallel_for(lightingGridDims.z, [&](int z) {
+      ispc::Multivariant_refineAOGrid(dims,
+          extinction.data(),
+          spacing,
+          radius,
+          z,
+          z + 1,
+          aoGrid.data());
+    });
+  }
+}
+
+void Multivariant::invalidateSampleCache()
+{
+  std::fill(sampleCacheCounts.begin(), sampleCacheCounts.end(), -1);
+}
+
+void Multivariant::updateSampleCache(FrameBuffer *fb, World *world)
+{
+  bool enabled = sampleCacheEnabled && fb;
+  const int channels = sampleCacheAttributes.size();
+  if (enabled) {
+    const size_t numSteps =
+        size_t(fb->getNumPixels().long_product()) * sampleCacheDepth;
+    const size_t bytes =
+        numSteps * (channels * sizeof(uint16_t) + sizeof(vec3f));
+    if (bytes <= sampleCacheMaxBytes) {
+      sampleCacheRejectedBytes = 0;
+    } else {
+      if (bytes != sampleCacheRejectedBytes) {
+        postStatusMsg(OSP_LOG_WARNING)
+            << "multivariant: the sample cache would take " << (bytes >> 20)
+            << " MB, more than 'sampleCacheMaxMemory', it is disabled";
+        sampleCacheRejectedBytes = bytes;
+      }
+      enabled = false;
+    }
+  }
+
+  if (!enabled) {
+    if (!sampleCacheCounts.empty()) {
+      sampleCacheValues = std::vector<uint16_t>();
+      sampleCacheSteps = std::vector<vec3f>();
+      sampleCacheCounts = std::vector<int>();
+      sampleCacheRays = std::vector<vec3f>();
+      sampleCacheModels = std::vector<void *>();
+      sampleCacheSize = vec2i(0);
+    }
+    ispc::Multivariant_setSampleCache(
+        getIE(), 0, 0, nullptr, nullptr, nullptr, nullptr, nullptr);
+    return;
+  }
+
+  const vec2i size = fb->getNumPixels();
+  if (size != sampleCacheSize || channels != sampleCacheChannels
+      || size_t(size.long_product()) * sampleCacheDepth
+          != sampleCacheSteps.size()) {
+    const size_t numPixels = size.long_product();
+    const size_t numSteps = numPixels * sampleCacheDepth;
+    sampleCacheValues.resize(numSteps * channels);
+    sampleCacheSteps.resize(numSteps);
+    sampleCacheCounts.resize(numPixels);
+    sampleCacheRays.resize(4 * numPixels);
+    sampleCacheModels.resize(numPixels);
+    sampleCacheSize = size;
+    sampleCacheChannels = channels;
+    invalidateSampleCache();
+  }
+
+  // a recommitted world may have moved or changed the volume
+  if (world != sampleCacheWorld || !world->scivisDataValid) {
+    sampleCacheWorld = world;
+    invalidateSampleCache();
+  }
+
+  ispc::Multivariant_setSampleCache(getIE(),
+      sampleCacheDepth,
+      sampleCacheChannels,
+      sampleCacheValues.data(),
+      sampleCacheSteps.data(),
+      sampleCacheCounts.data(),
+      sampleCacheRays.data(),
+      sampleCacheModels.data());
 }
 
 
   // WORLD SCIVISDATA?
-void *Multivariant::beginFrame(FrameBuffer *, World *world)
+void Multivariant::updateLabelGrids(World *world)
+{
+  if (labelTable.empty()) {
+    if (!labelGrids.empty()) {
+      labelGrids = std::vector<LabelGrid>();
+      labelGridWorld = nullptr;
+    }
+    ispc::Multivariant_setLabelGrids(
+        getIE(), 0, nullptr, nullptr, nullptr, nullptr);
+    return;
+  }
+
+  // labels change with the volumes and the two mask channels
+  if (labelGrids.empty() || world != labelGridWorld
+      || !world->scivisDataValid) {
+    labelGridWorld = world;
+    labelGrids.clear();
+    labelGridModels.clear();
+    labelGridDims.clear();
+    labelGridPointers.clear();
+    if (world->instances) {
+      for (auto &&instance : *world->instances) {
+        if (!instance->group->volumetricModels)
+          continue;
+        for (auto &&model : *instance->group->volumetricModels) {
+          auto found = std::find_if(labelGrids.begin(),
+              labelGrids.end(),
+              [&](const LabelGrid &g) { return g.model == model; });
+          if (found != labelGrids.end())
+            continue;
+
+          // one node per voxel, volumes without 'dimensions' get 128 nodes
+          // along the longest axis
+          LabelGrid grid;
+          grid.model = model;
+          grid.dims =
+              model->getVolume()->getParam<vec3i>("dimensions", vec3i(0));
+          if (reduce_min(grid.dims) < 2) {
+            const vec3f extent = model->bounds().size();
+            const float spacing = reduce_max(extent) / 127.f;
+            grid.dims = vec3i(std::max(int(extent.x / spacing) + 1, 2),
+                std::max(int(extent.y / spacing) + 1, 2),
+                std::max(int(extent.z / spacing) + 1, 2));
+          }
+          labelGrids.push_back(std::move(grid));
+        }
+      }
+    }
+
+    for (auto &grid : labelGrids) {
+      grid.labels.resize(grid.dims.long_product());
+      tasking::parallel_for(grid.dims.z, [&](int z) {
+        ispc::Multivariant_computeLabelGrid(getIE(),
+            grid.model->getIE(),
+            grid.dims.x,
+            grid.dims.y,
+            grid.dims.z,
+            z,
+            z + 1,
+            grid.labels.data());
+      });
+      labelGridModels.push_back(grid.model->getIE());
+      labelGridDims.push_back(grid.dims.x);
+      labelGridDims.push_back(grid.dims.y);
+      labelGridDims.push_back(grid.dims.z);
+      labelGridPointers.push_back(grid.labels.data());
+    }
+  }
+
+  ispc::Multivariant_setLabelGrids(getIE(),
+      labelGridModels.size(),
+      labelGridModels.data(),
+      labelGridDims.data(),
+      labelGridPointers.data(),
+      labelTable.data());
+}
+
+void Multivariant::updateOccupancyGrids(World *world)
+{
+  if (!segmentSkipping) {
+    if (!occupancyGrids.empty()) {
+      occupancyGrids = std::vector<OccupancyGrid>();
+      occupancyGridWorld = nullptr;
+    }
+    ispc::Multivariant_setOccupancyGrids(
+        getIE(), 0, nullptr, nullptr, nullptr);
+    return;
+  }
+
+  constexpr int words = 8;
+
+  // the cells of a brick only change with the volumes and the two channels
+  if (world != occupancyGridWorld || !world->scivisDataValid
+      || occupancyGrids.empty()) {
+    occupancyGridWorld = world;
+    occupancyGrids.clear();
+    if (world->instances) {
+      for (auto &&instance : *world->instances) {
+        if (!instance->group->volumetricModels)
+          continue;
+        for (auto &&model : *instance->group->volumetricModels) {
+          auto found = std::find_if(occupancyGrids.begin(),
+              occupancyGrids.end(),
+              [&](const OccupancyGrid &g) { return g.model == model; });
+          if (found != occupancyGrids.end())
+            continue;
+
+          // cubic bricks, 'occupancyGridResolution' along the longest axis
+          const vec3f extent = model->bounds().size();
+          const float brickSize =
+              reduce_max(extent) / occupancyGridResolution;
+          OccupancyGrid grid;
+          grid.model = model;
+          grid.dims = vec3i(std::max(int(std::ceil(extent.x / brickSize)), 1),
+              std::max(int(std::ceil(extent.y / brickSize)), 1),
+              std::max(int(std::ceil(extent.z / brickSize)), 1));
+          // every voxel, volumes without 'dimensions' get 128 nodes along
+          // the longest axis
+          grid.voxels =
+              model->getVolume()->getParam<vec3i>("dimensions", vec3i(0));
+          if (reduce_min(grid.voxels) < 2) {
+            const float spacing = reduce_max(extent) / 127.f;
+            grid.voxels = vec3i(std::max(int(extent.x / spacing) + 1, 2),
+                std::max(int(extent.y / spacing) + 1, 2),
+                std::max(int(extent.z / spacing) + 1, 2));
+          }
+          occupancyGrids.push_back(std::move(grid));
+        }
+      }
+    }
+
+    for (auto &grid : occupancyGrids) {
+      const int numBricks = grid.dims.long_product();
+      const int numTasks = (numBricks + 63) / 64;
+      grid.cells.resize(size_t(numBricks) * words);
+      tasking::parallel_for(numTasks, [&](int task) {
+        ispc::Multivariant_computeBrickCells(getIE(),
+            grid.model->getIE(),
+            grid.dims.x,
+            grid.dims.y,
+            grid.dims.z,
+            grid.voxels.x,
+            grid.voxels.y,
+            grid.voxels.z,
+            task * 64,
+            std::min(task * 64 + 64, numBricks),
+            grid.cells.data());
+      });
+    }
+    occupancyValid = false;
+  }
+
+  if (!occupancyValid) {
+    occupancyGridModels.clear();
+    occupancyGridDims.clear();
+    occupancyGridPointers.clear();
+    for (auto &grid : occupancyGrids) {
+      const size_t numBricks = grid.dims.long_product();
+      grid.occupied.resize(numBricks);
+      tasking::parallel_for(numBricks, [&](size_t b) {
+        uint32_t any = 0;
+        for (int w = 0; w < words; w++)
+          any |= grid.cells[b * words + w] & visibleCells[w];
+        grid.occupied[b] = any != 0;
+      });
+      occupancyGridModels.push_back(grid.model->getIE());
+      occupancyGridDims.push_back(grid.dims.x);
+      occupancyGridDims.push_back(grid.dims.y);
+      occupancyGridDims.push_back(grid.dims.z);
+      occupancyGridPointers.push_back(grid.occupied.data());
+    }
+    occupancyValid = true;
+  }
+
+  ispc::Multivariant_setOccupancyGrids(getIE(),
+      occupancyGridModels.size(),
+      occupancyGridModels.data(),
+      occupancyGridDims.data(),
+      occupancyGridPointers.data());
+}
+
+void *Multivariant::beginFrame(FrameBuffer *fb, World *world)
 {
   if (!world)
     return nullptr;
 
+  ScratchArena::beginFrame();
+  updateSampleCache(fb, world);
+  updateStepGrids(world);
+  updateGradientGrids(world);
+  updateLightingGrids(world);
+  updateLabelGrids(world);
+  updateOccupancyGrids(world);
+  updateOutputLayers(fb);
+  updateOutputDepth(fb);
+  updatePixelMask(fb);
+  updatePixelStatistics(fb);
+
   const bool visibleLightListValid = visibleLights == scannedVisibleLightList;
 
   if (world->scivisDataValid && visibleLightListValid)
@@ -130,4 +1296,17 @@ void *Multivariant::beginFrame(FrameBuffer *, World *world)
   return nullptr;
 }
 
+void Multivariant::endFrame(FrameBuffer *fb, void *perFrameData)
+{
+  Renderer::endFrame(fb, perFrameData);
+
+  const size_t peak = ScratchArena::peakBytes();
+  if (peak != reportedScratchPeak) {
+    reportedScratchPeak = peak;
+    postStatusMsg(OSP_LOG_DEBUG)
+        << "multivariant: peak traversal scratch per thread " << peak
+        << " bytes";
+  }
+}
+
 } // namespace ospray
@@ -1,8 +1,10 @@
 // Copyright 2020-2021 Intel Corporation
 // SPDX-License-Identifier: Apache-2.0
 
+#include <tuple>
 // ospray
 #include "render/Renderer.h"
+#include "volume/VolumetricModel.h"
 #include "volume/transferFunction/TransferFunction.h"
 
 namespace ospray {
@@ -13,9 +15,26 @@ struct Multivariant : public Renderer
   std::string toString() const override;
   void commit() override;
   void *beginFrame(FrameBuffer *, World *) override;
+  void endFrame(FrameBuffer *, void *) override;
 
  private:
+  void updateSampleCache(FrameBuffer *, World *);
+  void updateOutputLayers(FrameBuffer *);
+  void updateOutputDepth(FrameBuffer *);
+  void updatePixelMask(FrameBuffer *);
+  void updatePixelStatistics(FrameBuffer *);
+  void invalidateSampleCache();
+  void updateStepGrids(World *);
+  void updateGradientGrids(World *);
+  void updateLightingGrids(World *);
+  void updateLabelGrids(World *);
+  void updateOccupancyGrids(World *);
+  void buildClassificationTable();
+  void clearShadowGrids();
+  void computeAOGrid();
+
   bool visibleLights{false};
+  size_t reportedScratchPeak{0};
   bool scannedVisibleLightList{true};
   Ref<const DataT<float> > bbox;
   Ref<const DataT<int> > renderAttributes;
@@ -26,6 +45,166 @@ struct Multivariant : public Renderer
   Ref<const DataT<int> > segColWithAlphaModifier;
   std::vector<void *> tfIEs;
   std::vector<void *> distFnIEs;
+
+  // inputs of the previous commit, derived structures are only rebuilt
+  // when something they depend on differs
+  using SetArguments = std::tuple<bool, int, float, float, int, int, int, int,
+      const void *, const void *, const void *, float, int, int, void *,
+      void *, const void *>;
+  SetArguments committedSetArguments;
+  bool setArgumentsValid{false};
+  std::vector<TransferFunction *> committedTfs;
+  std::vector<TransferFunction *> committedDistFns;
+  std::vector<vec4f> tfSamples;
+  std::vector<vec4f> distFnSamples;
+  std::vector<uint8_t> committedMask;
+  std::vector<int> committedSegCol;
+  std::vector<float> committedWeights;
+  vec2i committedPreIntegration{0};
+  std::vector<int> committedClassificationChannels;
+  std::vector<int> committedClassificationCells;
+  std::vector<vec4f> committedClassificationColors;
+  int committedClassificationResolution{0};
+  int committedNumAttributes{0};
+
+  // adaptive pixel sampling, running statistics of every pixel since the
+  // accumulation restarted
+  float pixelErrorThreshold{0.f};
+  int pixelMinSamples{4};
+  std::vector<vec4f> pixelMeans;
+  std::vector<vec2f> pixelErrors;
+
+  // deep sample buffer for transfer function only edits
+  bool sampleCacheEnabled{false};
+  int sampleCacheDepth{0};
+  size_t sampleCacheMaxBytes{0};
+  size_t sampleCacheRejectedBytes{0}; // last size over the cap, warned once
+  int sampleCacheChannels{0};
+  vec2i sampleCacheSize{0};
+  World *sampleCacheWorld{nullptr};
+  float sampleCacheSamplingRate{0.f};
+  std::vector<int> sampleCacheAttributes;
+  box3f sampleCacheROI{vec3f(neg_inf), vec3f(inf)};
+  std::vector<uint16_t> sampleCacheValues;
+  std::vector<vec3f> sampleCacheSteps;
+  std::vector<int> sampleCacheCounts;
+  std::vector<vec3f> sampleCacheRays;
+  std::vector<void *> sampleCacheModels;
+
+  // classification configurations rendered in the same traversal, matches
+  // MULTIVARIANT_MAX_LAYERS in Multivariant.ih
+  static constexpr int maxOutputLayers = 8;
+  Ref<const DataT<int> > outputBlendModes;
+  Ref<const DataT<float> > outputWeights;
+  Ref<const DataT<vec4f> > outputLayers;
+  // ray distance where the accumulated opacity crosses 50%, per pixel
+  Ref<const DataT<float> > outputDepth;
+  // 0 for pixels the application fills itself, e.g. from a reprojection
+  Ref<const DataT<unsigned char> > pixelMask;
+
+  // pre-integrated (front, back) classification table per transfer function
+  std::vector<vec4f> preIntegrationTables;
+  // summed-area table of the classified 2D histogram mask (blend mode 5)
+  std::vector<vec4f> maskIntegrals;
+
+  // adaptive sampling, step size multiplier per brick of every volume
+  struct StepGrid
+  {
+    VolumetricModel *model{nullptr};
+    vec3i dims{0};
+    std::vector<range1f> ranges; // value range, [brick][channel]
+    std::vector<float> scales;
+  };
+  bool adaptiveSampling{false};
+  float adaptiveThreshold{0.f};
+  float adaptiveMaxStepScale{1.f};
+  int adaptiveGridResolution{0};
+  bool stepScalesValid{false};
+  World *stepGridWorld{nullptr};
+  std::vector<int> stepGridAttributes;
+  std::vector<StepGrid> stepGrids;
+  std::vector<void *> stepGridModels;
+  std::vector<int> stepGridDims;
+  std::vector<float *> stepGridScales;
+
+  // precomputed gradients for shading, one grid per volume
+  struct GradientGrid
+  {
+    VolumetricModel *model{nullptr};
+    vec3i dims{0};
+    std::vector<uint16_t> codes;
+  };
+  bool gradientVolume{false};
+  World *gradientGridWorld{nullptr};
+  std::vector<GradientGrid> gradientGrids;
+  std::vector<void *> gradientGridModels;
+  std::vector<int> gradientGridDims;
+  std::vector<uint16_t *> gradientGridCodes;
+
+  // world space grids replacing shadow rays of directional lights and AO
+  // rays, all derived from the extinction of the classified volumes
+  bool shadowsEnabled{false};
+  bool shadowGridEnabled{false};
+  bool aoVolumeEnabled{false};
+  bool aoVolumeRefine{false};
+  int aoSamples{0};
+  float aoRadius{0.f};
+  int lightingGridResolution{0};
+  bool extinctionValid{false};
+  World *lightingGridWorld{nullptr};
+  box3f lightingGridBounds;
+  vec3i lightingGridDims{0};
+  std::vector<float> extinction;
+  std::vector<vec3f> shadowGridLights; // direction to each light, 0 if none
+  std::vector<std::vector<float>> shadowGrids;
+  std::vector<float *> shadowGridPointers;
+  std::vector<float> aoGrid;
+  std::vector<int> lightShadowGrids;
+
+  // blend mode 5 mask texel per voxel, classified through a table that
+  // follows the mask and the distance functions
+  struct LabelGrid
+  {
+    VolumetricModel *model{nullptr};
+    vec3i dims{0};
+    std::vector<uint16_t> labels;
+  };
+  bool segmentLabels{false};
+  World *labelGridWorld{nullptr};
+  std::vector<int> labelGridAttributes;
+  std::vector<LabelGrid> labelGrids;
+  std::vector<void *> labelGridModels;
+  std::vector<int> labelGridDims;
+  std::vector<uint16_t *> labelGridPointers;
+  std::vector<vec4f> labelTable;
+
+  // blend mode 5 empty space skipping, coarse 2D mask cells per brick
+  // matched against the cells holding visible segments
+  struct OccupancyGrid
+  {
+    VolumetricModel *model{nullptr};
+    vec3i dims{0};
+    vec3i voxels{0}; // read to find the cells of the bricks
+    std::vector<uint32_t> cells; // bitset, [brick][word]
+    std::vector<uint8_t> occupied;
+  };
+  bool segmentSkipping{false};
+  int occupancyGridResolution{0};
+  bool occupancyValid{false};
+  World *occupancyGridWorld{nullptr};
+  std::vector<int> occupancyGridAttributes;
+  std::vector<uint32_t> visibleCells;
+  std::vector<OccupancyGrid> occupancyGrids;
+  std::vector<void *> occupancyGridModels;
+  std::vector<int> occupancyGridDims;
+  std::vector<uint8_t *> occupancyGridPointers;
+
+  // sparse classification table of blend mode 6, see classification.ih
+  std::vector<int> classificationChannels;
+  int classificationResolution{0};
+  int classificationCapacityLog2{0};
+  std::vector<uint32_t> classificationKeys;
+  std::vector<vec4f> classificationValues;
 };
 
 } // namespace ospray
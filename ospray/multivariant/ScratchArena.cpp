@@ -0,0 +1,127 @@
+// Copyright 2021 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ScratchArena.h"
+// std
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace ospray {
+
+namespace {
+
+// suits the widest ISPC target
+constexpr size_t scratchAlignment = 64;
+constexpr size_t scratchChunkSize = 1 << 20;
+
+std::atomic<int> frameID{0};
+std::atomic<size_t> framePeak{0};
+
+struct Chunk
+{
+  std::unique_ptr<uint8_t[]> memory;
+  size_t size{0};
+  size_t used{0};
+
+  uint8_t *base() const
+  {
+    return (uint8_t *)((uintptr_t(memory.get()) + scratchAlignment - 1)
+        & ~(scratchAlignment - 1));
+  }
+};
+
+// stored in front of every block to restore the arena state on pop
+struct Header
+{
+  size_t chunk;
+  size_t liveBefore;
+};
+
+struct Arena
+{
+  std::vector<Chunk> chunks;
+  size_t current{0};
+  size_t live{0};
+  size_t peak{0};
+  int frame{-1};
+
+  void *push(size_t bytes)
+  {
+    const size_t block = scratchAlignment
+        + ((bytes + scratchAlignment - 1) & ~(scratchAlignment - 1));
+
+    // continue in the next chunk that fits, add one if none does
+    while (current < chunks.size()
+        && chunks[current].used + block > chunks[current].size)
+      current++;
+    if (current == chunks.size()) {
+      Chunk chunk;
+      chunk.size = std::max(block, scratchChunkSize);
+      chunk.memory.reset(new uint8_t[chunk.size + scratchAlignment]);
+      chunks.push_back(std::move(chunk));
+    }
+
+    Chunk &chunk = chunks[current];
+    uint8_t *header = chunk.base() + chunk.used;
+    new (header) Header{current, live};
+    chunk.used += block;
+    live += block;
+
+    // peak of this thread in the current frame
+    const int frameNow = frameID.load(std::memory_order_relaxed);
+    if (frame != frameNow) {
+      frame = frameNow;
+      peak = 0;
+    }
+    if (live > peak) {
+      peak = live;
+      size_t global = framePeak.load(std::memory_order_relaxed);
+      while (peak > global
+          && !framePeak.compare_exchange_weak(global, peak))
+        ;
+    }
+
+    return header + scratchAlignment;
+  }
+
+  void pop(void *ptr)
+  {
+    uint8_t *header = (uint8_t *)ptr - scratchAlignment;
+    const Header h = *(Header *)header;
+    Chunk &chunk = chunks[h.chunk];
+    chunk.used = header - chunk.base();
+    // blocks behind are gone as well
+    for (size_t i = h.chunk + 1; i <= current && i < chunks.size(); i++)
+      chunks[i].used = 0;
+    current = h.chunk;
+    live = h.liveBefore;
+  }
+};
+
+thread_local Arena arena;
+
+} // namespace
+
+void ScratchArena::beginFrame()
+{
+  frameID++;
+  framePeak = 0;
+}
+
+size_t ScratchArena::peakBytes()
+{
+  return framePeak;
+}
+
+} // namespace ospray
+
+extern "C" void *Multivariant_scratchPush(uint64_t bytes)
+{
+  return ospray::arena.push(bytes);
+}
+
+extern "C" void Multivariant_scratchPop(void *ptr)
+{
+  ospray::arena.pop(ptr);
+}
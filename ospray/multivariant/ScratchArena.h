@@ -0,0 +1,26 @@
+// Copyright 2021 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// ospray
+#include "common/OSPCommon.h"
+
+namespace ospray {
+
+// Per-thread bump arena for the scratch memory of volume traversal. Blocks
+// are released in reverse order of allocation, memory stays with the
+// thread and is reused by the following rays and frames.
+struct ScratchArena
+{
+  // start a new frame for peak usage tracking
+  static void beginFrame();
+  // largest scratch in bytes a single thread used since beginFrame()
+  static size_t peakBytes();
+};
+
+} // namespace ospray
+
+// ISPC entry points
+extern "C" void *Multivariant_scratchPush(uint64_t bytes);
+extern "C" void Multivariant_scratchPop(void *ptr);
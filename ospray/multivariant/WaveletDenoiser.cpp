@@ -0,0 +1,163 @@
+// Copyright 2009-2021 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "WaveletDenoiser.h"
+#include "rkcommon/tasking/parallel_for.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace ospray {
+
+static float srgbToLinear(float c)
+{
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float c)
+{
+  return c <= 0.0031308f ? 12.92f * c
+                         : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+}
+
+static uint8_t quantize(float c)
+{
+  return uint8_t(clamp(c, 0.f, 1.f) * 255.f + 0.5f);
+}
+
+static float distance2(const vec3f &a, const vec3f &b)
+{
+  const vec3f d = a - b;
+  return dot(d, d);
+}
+
+std::string WaveletDenoiseFrameOp::toString() const
+{
+  return "ospray::WaveletDenoiseFrameOp";
+}
+
+void WaveletDenoiseFrameOp::commit()
+{
+  iterations = std::max(getParam<int>("iterations", 4), 1);
+  colorSigma = getParam<float>("colorSigma", 0.5f);
+  normalSigma = getParam<float>("normalSigma", 0.2f);
+  albedoSigma = getParam<float>("albedoSigma", 0.1f);
+}
+
+std::unique_ptr<LiveImageOp> WaveletDenoiseFrameOp::attach(
+    FrameBufferView &fbView)
+{
+  return rkcommon::make_unique<LiveWaveletDenoiseFrameOp>(fbView, *this);
+}
+
+LiveWaveletDenoiseFrameOp::LiveWaveletDenoiseFrameOp(
+    FrameBufferView &_fbView, const WaveletDenoiseFrameOp &op)
+    : LiveFrameOp(_fbView),
+      iterations(op.iterations),
+      colorSigma(op.colorSigma),
+      normalSigma(op.normalSigma),
+      albedoSigma(op.albedoSigma)
+{}
+
+void LiveWaveletDenoiseFrameOp::readColor()
+{
+  const size_t numPixels = fbView.fbDims.long_product();
+  color.resize(numPixels);
+  filtered.resize(numPixels);
+  if (fbView.colorBufferFormat == OSP_FB_RGBA32F) {
+    std::memcpy(color.data(), fbView.colorBuffer, numPixels * sizeof(vec4f));
+    return;
+  }
+
+  const bool srgb = fbView.colorBufferFormat == OSP_FB_SRGBA;
+  float decode[256];
+  for (int i = 0; i < 256; i++)
+    decode[i] = srgb ? srgbToLinear(i / 255.f) : i / 255.f;
+  const uint8_t *pixels = (const uint8_t *)fbView.colorBuffer;
+  tasking::parallel_for(numPixels, [&](size_t i) {
+    const uint8_t *p = pixels + 4 * i;
+    color[i] = vec4f(decode[p[0]], decode[p[1]], decode[p[2]], p[3] / 255.f);
+  });
+}
+
+void LiveWaveletDenoiseFrameOp::writeColor()
+{
+  const size_t numPixels = fbView.fbDims.long_product();
+  if (fbView.colorBufferFormat == OSP_FB_RGBA32F) {
+    std::memcpy(fbView.colorBuffer, color.data(), numPixels * sizeof(vec4f));
+    return;
+  }
+
+  const bool srgb = fbView.colorBufferFormat == OSP_FB_SRGBA;
+  uint8_t *pixels = (uint8_t *)fbView.colorBuffer;
+  tasking::parallel_for(numPixels, [&](size_t i) {
+    const vec4f &c = color[i];
+    uint8_t *p = pixels + 4 * i;
+    p[0] = quantize(srgb ? linearToSrgb(c.x) : c.x);
+    p[1] = quantize(srgb ? linearToSrgb(c.y) : c.y);
+    p[2] = quantize(srgb ? linearToSrgb(c.z) : c.z);
+    p[3] = quantize(c.w);
+  });
+}
+
+void LiveWaveletDenoiseFrameOp::process(const Camera *)
+{
+  if (fbView.colorBufferFormat == OSP_FB_NONE || !fbView.colorBuffer)
+    return;
+
+  readColor();
+
+  const vec2i size = fbView.fbDims;
+  const vec3f *normals = fbView.normalBuffer;
+  const vec3f *albedos = fbView.albedoBuffer;
+  const float kernel[5] = {1.f / 16.f, 1.f / 4.f, 3.f / 8.f, 1.f / 4.f, 1.f / 16.f};
+  const float rcpNormalSigma2 = 1.f / (normalSigma * normalSigma);
+  const float rcpAlbedoSigma2 = 1.f / (albedoSigma * albedoSigma);
+
+  for (int iteration = 0; iteration < iterations; iteration++) {
+    // the holes of the kernel double, the color tolerance halves as the
+    // noise left shrinks
+    const int step = 1 << iteration;
+    const float sigma = colorSigma / step;
+    const float rcpColorSigma2 = 1.f / (sigma * sigma);
+
+    tasking::parallel_for(size_t(size.y), [&](size_t y) {
+      for (int x = 0; x < size.x; x++) {
+        const size_t p = y * size.x + x;
+        const vec4f &c = color[p];
+        vec4f sum(0.f);
+        float weightSum = 0.f;
+        for (int dy = -2; dy <= 2; dy++) {
+          const int qy = int(y) + dy * step;
+          if (qy < 0 || qy >= size.y)
+            continue;
+          for (int dx = -2; dx <= 2; dx++) {
+            const int qx = x + dx * step;
+            if (qx < 0 || qx >= size.x)
+              continue;
+            const size_t q = size_t(qy) * size.x + qx;
+            float d = distance2(vec3f(c.x, c.y, c.z),
+                          vec3f(color[q].x, color[q].y, color[q].z))
+                * rcpColorSigma2;
+            // untraced pixels ('pixelMask') have no normal and drop out
+            if (normals)
+              d += distance2(normals[p], normals[q]) * rcpNormalSigma2;
+            if (albedos)
+              d += distance2(albedos[p], albedos[q]) * rcpAlbedoSigma2;
+            const float w = kernel[dx + 2] * kernel[dy + 2] * std::exp(-d);
+            sum += w * color[q];
+            weightSum += w;
+          }
+        }
+        // the center tap always has weight, weightSum > 0
+        filtered[p] = sum / weightSum;
+      }
+    });
+    std::swap(color, filtered);
+  }
+
+  writeColor();
+}
+
+} // namespace ospray
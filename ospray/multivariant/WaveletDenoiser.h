@@ -0,0 +1,46 @@
+// Copyright 2009-2021 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <vector>
+// ospray
+#include "fb/ImageOp.h"
+
+namespace ospray {
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) on the CPU,
+// guided by the albedo and normal channels of the frame buffer. Needs no
+// external library, unlike the "denoiser" module.
+struct WaveletDenoiseFrameOp : public FrameOp
+{
+  std::string toString() const override;
+  void commit() override;
+  std::unique_ptr<LiveImageOp> attach(FrameBufferView &fbView) override;
+
+  int iterations{4}; // the kernel spans 4 * 2^iterations + 1 pixels
+  float colorSigma{0.5f};
+  float normalSigma{0.2f};
+  float albedoSigma{0.1f};
+};
+
+struct LiveWaveletDenoiseFrameOp : public LiveFrameOp
+{
+  LiveWaveletDenoiseFrameOp(
+      FrameBufferView &fbView, const WaveletDenoiseFrameOp &op);
+  void process(const Camera *) override;
+
+ private:
+  void readColor();
+  void writeColor();
+
+  int iterations;
+  float colorSigma;
+  float normalSigma;
+  float albedoSigma;
+  // linear color, ping-ponged between the iterations
+  std::vector<vec4f> color;
+  std::vector<vec4f> filtered;
+};
+
+} // namespace ospray